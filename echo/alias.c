@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_eal.h>
+
+#include "alias.h"
+
+// Build the alias table for the weights given (Vose's method)
+alias_table_t *alias_create(const double *values, const double *weights, uint32_t n)
+{
+	alias_table_t *table = (alias_table_t *)rte_zmalloc(NULL, sizeof(alias_table_t), 64);
+	if (table == NULL)
+	{
+		return NULL;
+	}
+
+	table->nr_entries = n;
+	table->values = (double *)rte_malloc(NULL, n * sizeof(double), 64);
+	table->prob = (double *)rte_malloc(NULL, n * sizeof(double), 64);
+	table->alias = (uint32_t *)rte_malloc(NULL, n * sizeof(uint32_t), 64);
+
+	// temporary work lists
+	double *scaled = (double *)malloc(n * sizeof(double));
+	uint32_t *small = (uint32_t *)malloc(n * sizeof(uint32_t));
+	uint32_t *large = (uint32_t *)malloc(n * sizeof(uint32_t));
+
+	if (table->values == NULL || table->prob == NULL || table->alias == NULL || scaled == NULL || small == NULL || large == NULL)
+	{
+		free(scaled);
+		free(small);
+		free(large);
+		alias_free(table);
+		return NULL;
+	}
+
+	double sum = 0.0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		sum += weights[i];
+	}
+
+	// split the columns into the ones below and above the average
+	uint32_t nr_small = 0;
+	uint32_t nr_large = 0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		table->values[i] = values ? values[i] : (double)i;
+		table->alias[i] = i;
+		scaled[i] = weights[i] * n / sum;
+		if (scaled[i] < 1.0)
+		{
+			small[nr_small++] = i;
+		}
+		else
+		{
+			large[nr_large++] = i;
+		}
+	}
+
+	// fill each small column with the excess of a large one
+	while (nr_small > 0 && nr_large > 0)
+	{
+		uint32_t s = small[--nr_small];
+		uint32_t l = large[--nr_large];
+
+		table->prob[s] = scaled[s];
+		table->alias[s] = l;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		if (scaled[l] < 1.0)
+		{
+			small[nr_small++] = l;
+		}
+		else
+		{
+			large[nr_large++] = l;
+		}
+	}
+
+	// the remaining columns are full (up to rounding errors)
+	while (nr_large > 0)
+	{
+		table->prob[large[--nr_large]] = 1.0;
+	}
+	while (nr_small > 0)
+	{
+		table->prob[small[--nr_small]] = 1.0;
+	}
+
+	free(scaled);
+	free(small);
+	free(large);
+
+	return table;
+}
+
+// Load an empirical distribution from a file with one "value weight" pair per line.
+// If the first line is "cdf", the second column is a cumulative distribution instead of a histogram.
+alias_table_t *alias_load_file(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	if (fp == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot open the distribution file %s.\n", filename);
+	}
+
+	uint32_t n = 0;
+	uint32_t capacity = 1024;
+	double *values = (double *)malloc(capacity * sizeof(double));
+	double *weights = (double *)malloc(capacity * sizeof(double));
+	if (values == NULL || weights == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the distribution entries.\n");
+	}
+
+	int cdf = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		// skip comments and empty lines
+		if (line[0] == '#' || line[0] == '\n')
+		{
+			continue;
+		}
+
+		if (n == 0 && strncmp(line, "cdf", 3) == 0)
+		{
+			cdf = 1;
+			continue;
+		}
+
+		if (n == capacity)
+		{
+			capacity *= 2;
+			values = (double *)realloc(values, capacity * sizeof(double));
+			weights = (double *)realloc(weights, capacity * sizeof(double));
+			if (values == NULL || weights == NULL)
+			{
+				rte_exit(EXIT_FAILURE, "Cannot alloc the distribution entries.\n");
+			}
+		}
+
+		if (sscanf(line, "%lf %lf", &values[n], &weights[n]) != 2 || values[n] < 0 || weights[n] < 0)
+		{
+			rte_exit(EXIT_FAILURE, "Invalid line in the distribution file %s: %s", filename, line);
+		}
+		n++;
+	}
+	fclose(fp);
+
+	if (n == 0)
+	{
+		rte_exit(EXIT_FAILURE, "The distribution file %s is empty.\n", filename);
+	}
+
+	// turn the CDF into a histogram
+	if (cdf)
+	{
+		for (uint32_t i = n - 1; i > 0; i--)
+		{
+			weights[i] -= weights[i - 1];
+			if (weights[i] < 0)
+			{
+				rte_exit(EXIT_FAILURE, "The CDF in %s is not monotonic.\n", filename);
+			}
+		}
+	}
+
+	// the weights are normalized by their sum
+	double sum = 0.0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		sum += weights[i];
+	}
+	if (sum <= 0)
+	{
+		rte_exit(EXIT_FAILURE, "The weights in the distribution file %s are all zero.\n", filename);
+	}
+
+	alias_table_t *table = alias_create(values, weights, n);
+	if (table == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the alias table.\n");
+	}
+
+	free(values);
+	free(weights);
+
+	return table;
+}
+
+// Mean of the distribution represented by the table
+double alias_mean(const alias_table_t *table)
+{
+	// each column holds 1/n of the mass, split between itself and its alias
+	double mean = 0.0;
+	for (uint32_t i = 0; i < table->nr_entries; i++)
+	{
+		mean += table->prob[i] * table->values[i] + (1.0 - table->prob[i]) * table->values[table->alias[i]];
+	}
+
+	return mean / table->nr_entries;
+}
+
+// Multiply all values of the table by the factor
+void alias_scale(alias_table_t *table, double factor)
+{
+	for (uint32_t i = 0; i < table->nr_entries; i++)
+	{
+		table->values[i] *= factor;
+	}
+}
+
+// Release the table
+void alias_free(alias_table_t *table)
+{
+	if (table == NULL)
+	{
+		return;
+	}
+
+	rte_free(table->values);
+	rte_free(table->prob);
+	rte_free(table->alias);
+	rte_free(table);
+}
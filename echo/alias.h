@@ -0,0 +1,32 @@
+#ifndef __ALIAS_H__
+#define __ALIAS_H__
+
+#include <stdint.h>
+
+#include <rte_malloc.h>
+
+// Walker/Vose alias table over a discrete distribution
+typedef struct alias_table_t
+{
+	uint32_t nr_entries;
+	double *values;
+	double *prob;
+	uint32_t *alias;
+} alias_table_t;
+
+alias_table_t *alias_create(const double *values, const double *weights, uint32_t n);
+alias_table_t *alias_load_file(const char *filename);
+double alias_mean(const alias_table_t *table);
+void alias_scale(alias_table_t *table, double factor);
+void alias_free(alias_table_t *table);
+
+// Pick an entry in O(1): the upper 32 bits of r0 choose the column, r1 decides between the column and its alias
+static inline uint32_t alias_sample(const alias_table_t *table, uint64_t r0, uint64_t r1)
+{
+	uint32_t column = (uint32_t)(((r0 >> 32) * table->nr_entries) >> 32);
+	double coin = (r1 >> 11) * (1.0 / 9007199254740992.0);
+
+	return coin < table->prob[column] ? column : table->alias[column];
+}
+
+#endif // __ALIAS_H__
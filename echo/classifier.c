@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include <rte_common.h>
+
+#include "classifier.h"
+
+// Create an empty table for the flows (twice as many slots, rounded up to a power of two; NULL if they do not fit in 32 bits)
+classifier_t *classifier_create(uint32_t nr_flows)
+{
+	if (nr_flows > CLASSIFIER_MAX_FLOWS)
+	{
+		return NULL;
+	}
+
+	classifier_t *c = (classifier_t *)rte_zmalloc(NULL, sizeof(classifier_t), 64);
+	if (c == NULL)
+	{
+		return NULL;
+	}
+
+	uint32_t nr_slots = rte_align32pow2(2 * nr_flows);
+	c->mask = nr_slots - 1;
+	c->entries = (classifier_entry_t *)rte_malloc(NULL, (uint64_t)nr_slots * sizeof(classifier_entry_t), 64);
+	if (c->entries == NULL)
+	{
+		rte_free(c);
+		return NULL;
+	}
+
+	// empty slots have no flow
+	memset(c->entries, 0xff, (uint64_t)nr_slots * sizeof(classifier_entry_t));
+
+	return c;
+}
+
+// Add the flow keyed on the 5-tuple of its responses (network byte order, as in the headers)
+void classifier_add(classifier_t *c, uint32_t src_addr, uint32_t dst_addr, uint16_t src_port, uint16_t dst_port, uint32_t flow_id)
+{
+	uint64_t addrs = ((uint64_t)src_addr << 32) | dst_addr;
+	uint32_t ports = ((uint32_t)src_port << 16) | dst_port;
+
+	uint32_t slot = classifier_hash(addrs, ports) & c->mask;
+	while (c->entries[slot].flow_id != CLASSIFIER_MISS)
+	{
+		slot = (slot + 1) & c->mask;
+	}
+
+	c->entries[slot].addrs = addrs;
+	c->entries[slot].ports = ports;
+	c->entries[slot].flow_id = flow_id;
+}
+
+// Release the table
+void classifier_free(classifier_t *c)
+{
+	if (c == NULL)
+	{
+		return;
+	}
+
+	rte_free(c->entries);
+	rte_free(c);
+}
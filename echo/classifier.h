@@ -0,0 +1,111 @@
+#ifndef __CLASSIFIER_H__
+#define __CLASSIFIER_H__
+
+#include <stdint.h>
+
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_malloc.h>
+#include <rte_prefetch.h>
+#include <rte_hash_crc.h>
+#include <rte_branch_prediction.h>
+
+#define CLASSIFIER_RTE_FLOW 0
+#define CLASSIFIER_SOFTWARE 1
+#define CLASSIFIER_ASYNC 2
+#define CLASSIFIER_MISS UINT32_MAX
+#define CLASSIFIER_MAX_FLOWS (1U << 30)
+
+// 5-tuple of a response (TCP only, so the protocol is implicit) and its flow id, 16 bytes (4 per cache line)
+typedef struct classifier_entry_t
+{
+	uint64_t addrs;
+	uint32_t ports;
+	uint32_t flow_id;
+} classifier_entry_t;
+
+// Open-addressing hash table with linear probing (at most half full, so at most CLASSIFIER_MAX_FLOWS flows in 2^31 slots)
+typedef struct classifier_t
+{
+	uint32_t mask;
+	classifier_entry_t *entries;
+} classifier_t;
+
+extern classifier_t *flow_classifier_table;
+
+classifier_t *classifier_create(uint32_t nr_flows);
+void classifier_add(classifier_t *c, uint32_t src_addr, uint32_t dst_addr, uint16_t src_port, uint16_t dst_port, uint32_t flow_id);
+void classifier_free(classifier_t *c);
+
+static inline uint32_t classifier_hash(uint64_t addrs, uint32_t ports)
+{
+	return rte_hash_crc_4byte(ports, rte_hash_crc_8byte(addrs, 0));
+}
+
+// Extract the 5-tuple of the packet as seen on the wire (returns 0 for non-TCP packets)
+static inline int classifier_key(struct rte_mbuf *pkt, uint64_t *addrs, uint32_t *ports)
+{
+	struct rte_ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
+	if (unlikely(eth_hdr->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)))
+	{
+		return 0;
+	}
+
+	struct rte_ipv4_hdr *ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+	if (unlikely(ipv4_hdr->next_proto_id != IPPROTO_TCP))
+	{
+		return 0;
+	}
+
+	struct rte_tcp_hdr *tcp_hdr = (struct rte_tcp_hdr *)((uint8_t *)ipv4_hdr + (ipv4_hdr->version_ihl & 0x0f) * 4);
+	*addrs = ((uint64_t)ipv4_hdr->src_addr << 32) | ipv4_hdr->dst_addr;
+	*ports = ((uint32_t)tcp_hdr->src_port << 16) | tcp_hdr->dst_port;
+
+	return 1;
+}
+
+// Tag a whole RX burst with the flow ids (hash.fdir.hi, as the rte_flow MARK action does), CLASSIFIER_MISS if unknown
+static inline void classifier_lookup_bulk(const classifier_t *c, struct rte_mbuf **pkts, uint16_t nb_pkts)
+{
+	uint64_t addrs[nb_pkts];
+	uint32_t ports[nb_pkts];
+	uint32_t slots[nb_pkts];
+
+	// first pass: hash all keys and prefetch their buckets, so the misses overlap
+	for (uint16_t i = 0; i < nb_pkts; i++)
+	{
+		if (unlikely(!classifier_key(pkts[i], &addrs[i], &ports[i])))
+		{
+			slots[i] = CLASSIFIER_MISS;
+			continue;
+		}
+		slots[i] = classifier_hash(addrs[i], ports[i]) & c->mask;
+		rte_prefetch0(&c->entries[slots[i]]);
+	}
+
+	// second pass: probe the (now cached) buckets
+	for (uint16_t i = 0; i < nb_pkts; i++)
+	{
+		uint32_t flow_id = CLASSIFIER_MISS;
+		uint32_t slot = slots[i];
+		if (likely(slot != CLASSIFIER_MISS))
+		{
+			// the table is at most half full, so an empty slot ends the probing
+			while (c->entries[slot].flow_id != CLASSIFIER_MISS)
+			{
+				const classifier_entry_t *e = &c->entries[slot];
+				if (e->addrs == addrs[i] && e->ports == ports[i])
+				{
+					flow_id = e->flow_id;
+					break;
+				}
+				slot = (slot + 1) & c->mask;
+			}
+		}
+		pkts[i]->hash.fdir.hi = flow_id;
+	}
+}
+
+#endif // __CLASSIFIER_H__
@@ -0,0 +1,72 @@
+#include <string.h>
+
+#include <rte_eal.h>
+
+#include "deferred.h"
+
+// Create the deferred queue of nr_flows flows with room for capacity parked requests
+deferred_queue_t *deferred_create(uint32_t nr_flows, uint32_t capacity, uint32_t digits)
+{
+	deferred_queue_t *q = (deferred_queue_t *)rte_zmalloc(NULL, sizeof(deferred_queue_t), 64);
+	if (q == NULL)
+	{
+		return NULL;
+	}
+
+	q->nr_flows = nr_flows;
+	q->capacity = capacity;
+	q->head = (uint32_t *)rte_malloc(NULL, nr_flows * sizeof(uint32_t), 64);
+	q->tail = (uint32_t *)rte_malloc(NULL, nr_flows * sizeof(uint32_t), 64);
+	q->blocked = (uint32_t *)rte_malloc(NULL, nr_flows * sizeof(uint32_t), 64);
+	q->pool = (deferred_request_t *)rte_malloc(NULL, capacity * sizeof(deferred_request_t), 64);
+	q->waited = histogram_create(digits);
+	if (q->head == NULL || q->tail == NULL || q->blocked == NULL || q->pool == NULL || q->waited == NULL)
+	{
+		deferred_free(q);
+		return NULL;
+	}
+
+	// all flows are empty and all entries are free
+	memset(q->head, 0xff, nr_flows * sizeof(uint32_t));
+	for (uint32_t e = 0; e < capacity; e++)
+	{
+		q->pool[e].next = (e + 1 < capacity) ? e + 1 : DEFERRED_NONE;
+	}
+	q->free_head = 0;
+
+	return q;
+}
+
+// Drop all parked requests, returning how many there were
+uint64_t deferred_reset(deferred_queue_t *q)
+{
+	uint64_t dropped = q->nb_parked;
+
+	for (uint32_t k = 0; k < q->nb_blocked; k++)
+	{
+		uint32_t flow = q->blocked[k];
+		while (deferred_has(q, flow))
+		{
+			deferred_pop(q, flow);
+		}
+	}
+	q->nb_blocked = 0;
+
+	return dropped;
+}
+
+// Free the deferred queue
+void deferred_free(deferred_queue_t *q)
+{
+	if (q == NULL)
+	{
+		return;
+	}
+
+	rte_free(q->head);
+	rte_free(q->tail);
+	rte_free(q->blocked);
+	rte_free(q->pool);
+	histogram_free(q->waited);
+	rte_free(q);
+}
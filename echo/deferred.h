@@ -0,0 +1,96 @@
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+
+#include <stdint.h>
+
+#include <rte_malloc.h>
+
+#include "histogram.h"
+
+#define DEFERRED_POOL_ELEMENTS 64 * 1024
+#define DEFERRED_NONE UINT32_MAX
+#define DEFERRED_POLL_IN_US 10
+#define DEFERRED_DRAIN_IN_US 1000000
+
+// Request parked while the receive window of its flow is closed (the packet is built when it is released)
+typedef struct deferred_request_t
+{
+	uint64_t deadline;
+	uint64_t iterations;
+	uint64_t randomness;
+	uint32_t flow_id;
+	uint32_t next;
+	uint32_t request_size;
+	uint32_t response_size;
+} deferred_request_t;
+
+// Parked requests of the flows of one TX lcore: a FIFO per flow (indexed 0..nr_flows-1) over a shared pool of entries,
+// the list of flows with parked requests, and how long the released requests waited (in ns)
+typedef struct deferred_queue_t
+{
+	uint32_t nr_flows;
+	uint32_t capacity;
+	uint32_t free_head;
+	uint32_t nb_blocked;
+	uint64_t nb_parked;
+	uint32_t *head;
+	uint32_t *tail;
+	uint32_t *blocked;
+	deferred_request_t *pool;
+	histogram_t *waited;
+} deferred_queue_t;
+
+deferred_queue_t *deferred_create(uint32_t nr_flows, uint32_t capacity, uint32_t digits);
+uint64_t deferred_reset(deferred_queue_t *q);
+void deferred_free(deferred_queue_t *q);
+
+// Check whether the flow has parked requests
+static inline int deferred_has(const deferred_queue_t *q, uint32_t flow)
+{
+	return q->head[flow] != DEFERRED_NONE;
+}
+
+// Append the request to the FIFO of the flow (-1 if the pool is full)
+static inline int deferred_park(deferred_queue_t *q, uint32_t flow, const deferred_request_t *req)
+{
+	uint32_t e = q->free_head;
+	if (e == DEFERRED_NONE)
+	{
+		return -1;
+	}
+	q->free_head = q->pool[e].next;
+
+	q->pool[e] = *req;
+	q->pool[e].next = DEFERRED_NONE;
+	if (q->head[flow] == DEFERRED_NONE)
+	{
+		q->head[flow] = e;
+		q->blocked[q->nb_blocked++] = flow;
+	}
+	else
+	{
+		q->pool[q->tail[flow]].next = e;
+	}
+	q->tail[flow] = e;
+	q->nb_parked++;
+
+	return 0;
+}
+
+// Oldest parked request of the flow (which must have one)
+static inline deferred_request_t *deferred_peek(deferred_queue_t *q, uint32_t flow)
+{
+	return &q->pool[q->head[flow]];
+}
+
+// Remove the oldest parked request of the flow (the caller drops the flow from the blocked list once it is empty)
+static inline void deferred_pop(deferred_queue_t *q, uint32_t flow)
+{
+	uint32_t e = q->head[flow];
+	q->head[flow] = q->pool[e].next;
+	q->pool[e].next = q->free_head;
+	q->free_head = e;
+	q->nb_parked--;
+}
+
+#endif // __DEFERRED_H__
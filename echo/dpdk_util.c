@@ -1,5 +1,101 @@
 #include "dpdk_util.h"
 
+// Template table of the async flow API (one rule per flow) and its templates
+static struct rte_flow_template_table *flow_table;
+static struct rte_flow_pattern_template *pattern_template;
+static struct rte_flow_actions_template *actions_template;
+
+// Software segmentation of the requests longer than the MSS when the NIC has no TSO
+static struct rte_gso_ctx gso_ctx;
+static struct rte_mempool *pktmbuf_pool_gso;
+
+// Read-only payload shared by all the requests with -Z (attached to their second segment, never written)
+static struct rte_mempool *pktmbuf_pool_ext;
+static void *shared_payloads[ZC_SHARED_BUFFERS];
+static rte_iova_t shared_payloads_iova[ZC_SHARED_BUFFERS];
+static uint16_t shared_payloads_len[ZC_SHARED_BUFFERS];
+static struct rte_mbuf_ext_shared_info *shared_payloads_shinfo[ZC_SHARED_BUFFERS];
+
+// The shared payloads keep one reference of their own, so the callback never runs while the port is up
+static void shared_payload_free(void *addr, void *opaque)
+{
+}
+
+// Allocate the shared payloads and the pool of the mbufs attached to them (no data room of their own)
+static void init_shared_payloads(uint16_t portid)
+{
+	int socket = rte_eth_dev_socket_id(portid);
+
+	pktmbuf_pool_ext = rte_pktmbuf_pool_create("mbuf_pool_ext", PKTMBUF_POOL_ELEMENTS, MEMPOOL_CACHE_SIZE, 0, 0, socket);
+	if (pktmbuf_pool_ext == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot init external mbuf pool on socket %d\n", socket);
+	}
+
+	// the shared info sits at the end of each buffer, after the largest payload
+	uint32_t len = RTE_ALIGN_CEIL(tcp_payload_size + sizeof(struct rte_mbuf_ext_shared_info), RTE_CACHE_LINE_SIZE);
+	if (len > UINT16_MAX)
+	{
+		len = UINT16_MAX;
+	}
+
+	for (uint32_t i = 0; i < ZC_SHARED_BUFFERS; i++)
+	{
+		shared_payloads[i] = rte_zmalloc_socket("shared_payload", len, RTE_CACHE_LINE_SIZE, socket);
+		if (shared_payloads[i] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the shared payloads.\n");
+		}
+
+		shared_payloads_len[i] = len;
+		shared_payloads_shinfo[i] = rte_pktmbuf_ext_shinfo_init_helper(shared_payloads[i], &shared_payloads_len[i], shared_payload_free, NULL);
+		if (shared_payloads_shinfo[i] == NULL || shared_payloads_len[i] < tcp_payload_size)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot fit the shared payloads of %u bytes.\n", tcp_payload_size);
+		}
+		shared_payloads_iova[i] = rte_malloc_virt2iova(shared_payloads[i]);
+	}
+}
+
+// Chain len bytes of a shared payload after the headers of the request (each mbuf always takes the same buffer,
+// so no buffer gets more references than its 16-bit counter holds)
+void attach_shared_payload(struct rte_mbuf *pkt, uint32_t len)
+{
+	struct rte_mbuf *seg = rte_pktmbuf_alloc(pktmbuf_pool_ext);
+	if (seg == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the payload of a request.\n");
+	}
+
+	uint32_t i = ((uintptr_t)seg / RTE_CACHE_LINE_SIZE) % ZC_SHARED_BUFFERS;
+	rte_mbuf_ext_refcnt_update(shared_payloads_shinfo[i], 1);
+	rte_pktmbuf_attach_extbuf(seg, shared_payloads[i], shared_payloads_iova[i], shared_payloads_len[i], shared_payloads_shinfo[i]);
+	seg->data_len = len;
+	seg->pkt_len = len;
+
+	if (rte_pktmbuf_chain(pkt, seg) != 0)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot chain the payload of a request.\n");
+	}
+}
+
+// Set up rte_gso for the requests longer than the MSS (headers copied to direct mbufs, payload referenced by indirect ones)
+static void init_gso(uint16_t portid)
+{
+	pktmbuf_pool_gso = rte_pktmbuf_pool_create("mbuf_pool_gso", PKTMBUF_POOL_ELEMENTS, MEMPOOL_CACHE_SIZE, 0, 0, rte_eth_dev_socket_id(portid));
+	if (pktmbuf_pool_gso == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot init GSO mbuf pool on socket %d\n", rte_eth_dev_socket_id(portid));
+	}
+
+	gso_ctx.direct_pool = pktmbuf_pool_tx;
+	gso_ctx.indirect_pool = pktmbuf_pool_gso;
+	gso_ctx.gso_types = RTE_ETH_TX_OFFLOAD_TCP_TSO;
+	gso_ctx.gso_size = sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + tcp_mss;
+	gso_ctx.gso_ipid_flag = 0;
+	gso_ctx.flag = 0;
+}
+
 // Initialize DPDK configuration
 void init_DPDK(uint16_t portid, uint32_t seed)
 {
@@ -19,6 +115,18 @@ void init_DPDK(uint16_t portid, uint32_t seed)
 	struct rte_flow_error error;
 	rte_flow_flush(portid, &error);
 
+	// the RX lcores keep the receive time of each packet in a dynamic field of its mbuf
+	static const struct rte_mbuf_dynfield rx_tsc_desc = {
+			.name = "load_generator_rx_tsc",
+			.size = sizeof(uint64_t),
+			.align = __alignof__(uint64_t),
+	};
+	rx_tsc_dynfield = rte_mbuf_dynfield_register(&rx_tsc_desc);
+	if (rx_tsc_dynfield < 0)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot register the RX timestamp mbuf field.\n");
+	}
+
 	// allocate the packet pool
 	char s[64];
 	snprintf(s, sizeof(s), "mbuf_pool_rx");
@@ -28,16 +136,22 @@ void init_DPDK(uint16_t portid, uint32_t seed)
 		rte_exit(EXIT_FAILURE, "Cannot init RX mbuf pool on socket %d\n", rte_eth_dev_socket_id(portid));
 	}
 
+	// with zero copy the TX mbufs hold only the headers and the payload comes from the shared buffers
 	snprintf(s, sizeof(s), "mbuf_pool_tx");
-	pktmbuf_pool_tx = rte_pktmbuf_pool_create(s, PKTMBUF_POOL_ELEMENTS, MEMPOOL_CACHE_SIZE, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_eth_dev_socket_id(portid));
+	uint16_t tx_buf_size = zero_copy ? RTE_PKTMBUF_HEADROOM + ZC_HEADER_ROOM : RTE_MBUF_DEFAULT_BUF_SIZE;
+	pktmbuf_pool_tx = rte_pktmbuf_pool_create(s, PKTMBUF_POOL_ELEMENTS, MEMPOOL_CACHE_SIZE, 0, tx_buf_size, rte_eth_dev_socket_id(portid));
 	if (pktmbuf_pool_tx == NULL)
 	{
 		rte_exit(EXIT_FAILURE, "Cannot init TX mbuf pool on socket %d\n", rte_eth_dev_socket_id(portid));
 	}
+	if (zero_copy)
+	{
+		init_shared_payloads(portid);
+	}
 
 	// initialize the DPDK port
-	uint16_t nb_rx_queue = 1;
-	uint16_t nb_tx_queue = 1;
+	uint16_t nb_rx_queue = nr_rx_queues;
+	uint16_t nb_tx_queue = nr_tx_lcores;
 
 	if (init_DPDK_port(portid, nb_rx_queue, nb_tx_queue) != 0)
 	{
@@ -79,6 +193,31 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue)
 			},
 	};
 
+	// requests longer than the MSS are chained mbufs split by the NIC or, without TSO, by rte_gso before the TX burst
+	if (tcp_payload_size > tcp_mss || frame_size > RTE_MBUF_DEFAULT_DATAROOM || zero_copy)
+	{
+		if (!(dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_MULTI_SEGS))
+		{
+			rte_exit(EXIT_FAILURE, "The port cannot send requests of %u bytes (no multi-segment TX).\n", frame_size);
+		}
+		port_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_MULTI_SEGS;
+	}
+
+	if (tcp_payload_size > tcp_mss)
+	{
+		if (dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_TCP_TSO)
+		{
+			port_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_TCP_TSO;
+			tx_segmentation = TX_SEG_TSO;
+		}
+		else
+		{
+			init_gso(portid);
+			tx_segmentation = TX_SEG_SOFTWARE;
+		}
+		printf("requests of %u bytes are split into %u-byte segments by %s\n", tcp_payload_size, tcp_mss, tx_segmentation == TX_SEG_TSO ? "TSO" : "rte_gso");
+	}
+
 	// configure the NIC
 	retval = rte_eth_dev_configure(portid, nb_rx_queue, nb_tx_queue, &port_conf);
 	if (retval != 0)
@@ -120,6 +259,14 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue)
 		}
 	}
 
+	// the template-based flow API is configured before the port starts
+	if (flow_classifier == CLASSIFIER_ASYNC && configure_async_flows(portid) != 0)
+	{
+		printf("async flow API unavailable, falling back to a wildcard rule and the software classifier\n");
+		flow_classifier = CLASSIFIER_SOFTWARE;
+		flow_wildcard = 1;
+	}
+
 	// start the Ethernet port
 	retval = rte_eth_dev_start(portid);
 	if (retval < 0)
@@ -130,6 +277,47 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue)
 	return 0;
 }
 
+// Send the packets on the TX queue, segmenting in software the requests longer than the MSS when the NIC has no TSO
+void send_pkts(uint16_t portid, uint16_t qid, struct rte_mbuf **pkts, uint16_t nb_pkts)
+{
+	uint16_t nb_tx = 0;
+
+	if (tx_segmentation != TX_SEG_SOFTWARE)
+	{
+		while (nb_tx < nb_pkts)
+		{
+			nb_tx += rte_eth_tx_burst(portid, qid, &pkts[nb_tx], nb_pkts - nb_tx);
+		}
+		return;
+	}
+
+	struct rte_mbuf *segs[GSO_MAX_SEGMENTS];
+	for (uint16_t i = 0; i < nb_pkts; i++)
+	{
+		// the segments hold references to the payload of the request, so the request itself is released
+		int nb_segs = rte_gso_segment(pkts[i], &gso_ctx, segs, GSO_MAX_SEGMENTS);
+		if (nb_segs < 0)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot segment a request of %u bytes (%d).\n", pkts[i]->pkt_len, nb_segs);
+		}
+		if (nb_segs == 0)
+		{
+			segs[0] = pkts[i];
+			nb_segs = 1;
+		}
+		else
+		{
+			rte_pktmbuf_free(pkts[i]);
+		}
+
+		nb_tx = 0;
+		while (nb_tx < nb_segs)
+		{
+			nb_tx += rte_eth_tx_burst(portid, qid, &segs[nb_tx], nb_segs - nb_tx);
+		}
+	}
+}
+
 // Print the DPDK stats
 void print_dpdk_stats(uint32_t portid)
 {
@@ -206,63 +394,316 @@ void print_dpdk_stats(uint32_t portid)
 	free(xstats_names);
 }
 
-// Create and fill rte_flow to send to the NIC
-void insert_flow(uint16_t portid, uint32_t i)
+// Build the rule that marks the responses of the flow i and steers them to its RX queue
+static void build_flow_rule(flow_rule_t *rule, uint32_t i)
+{
+	tcp_control_block_t *block = &tcp_control_blocks[i];
+
+	memset(rule, 0, sizeof(flow_rule_t));
+
+	// the responses of the flow come from the server to the flow address and port
+	rule->ipv4.hdr.src_addr = block->dst_addr;
+	rule->ipv4.hdr.dst_addr = block->src_addr;
+	rule->ipv4_mask.hdr.src_addr = 0xFFFFFFFF;
+	rule->ipv4_mask.hdr.dst_addr = 0xFFFFFFFF;
+	rule->tcp.hdr.src_port = block->dst_port;
+	rule->tcp.hdr.dst_port = block->src_port;
+	rule->tcp_mask.hdr.src_port = 0xFFFF;
+	rule->tcp_mask.hdr.dst_port = 0xFFFF;
+	rule->mark.id = i;
+	rule->queue.index = i % nr_rx_queues;
+
+	rule->action[0].type = RTE_FLOW_ACTION_TYPE_QUEUE;
+	rule->action[0].conf = &rule->queue;
+	rule->action[1].type = RTE_FLOW_ACTION_TYPE_MARK;
+	rule->action[1].conf = &rule->mark;
+	rule->action[2].type = RTE_FLOW_ACTION_TYPE_END;
+
+	rule->pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+	rule->pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+	rule->pattern[1].spec = &rule->ipv4;
+	rule->pattern[1].mask = &rule->ipv4_mask;
+	rule->pattern[2].type = RTE_FLOW_ITEM_TYPE_TCP;
+	rule->pattern[2].spec = &rule->tcp;
+	rule->pattern[2].mask = &rule->tcp_mask;
+	rule->pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+}
+
+// Create and fill rte_flow to send to the NIC (returns -1 if the NIC cannot tag the flow)
+int insert_flow(uint16_t portid, uint32_t i)
 {
 	int ret;
-	int act_idx = 0;
-	int pattern_idx = 0;
 
 	struct rte_flow_attr attr = {};
 	struct rte_flow_error err = {};
-	struct rte_flow_item pattern[MAX_RTE_FLOW_PATTERN] = {};
-	struct rte_flow_action action[MAX_RTE_FLOW_ACTIONS] = {};
+	flow_rule_t rule;
 
 	attr.egress = 0;
 	attr.ingress = 1;
 
-	action[act_idx].type = RTE_FLOW_ACTION_TYPE_QUEUE;
-	action[act_idx].conf = &tcp_control_blocks[i].flow_queue_action;
-	act_idx++;
+	build_flow_rule(&rule, i);
+
+	// validate the rte_flow
+	ret = rte_flow_validate(portid, &attr, rule.pattern, rule.action, &err);
+	if (ret < 0)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Flow validation failed %s\n", err.message);
+		return -1;
+	}
+
+	// create the flow and insert to the NIC
+	struct rte_flow *flow = rte_flow_create(portid, &attr, rule.pattern, rule.action, &err);
+	if (flow == NULL)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Flow creation return %s\n", err.message);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Destroy the template table and its templates (after the rules that use them were flushed)
+static void destroy_async_flows(uint16_t portid)
+{
+	struct rte_flow_error err = {};
 
-	action[act_idx].type = RTE_FLOW_ACTION_TYPE_MARK;
-	action[act_idx].conf = &tcp_control_blocks[i].flow_mark_action;
-	act_idx++;
+	if (flow_table)
+	{
+		rte_flow_template_table_destroy(portid, flow_table, &err);
+	}
+	if (actions_template)
+	{
+		rte_flow_actions_template_destroy(portid, actions_template, &err);
+	}
+	if (pattern_template)
+	{
+		rte_flow_pattern_template_destroy(portid, pattern_template, &err);
+	}
+	flow_table = NULL;
+	actions_template = NULL;
+	pattern_template = NULL;
+}
 
-	action[act_idx].type = RTE_FLOW_ACTION_TYPE_END;
-	action[act_idx].conf = NULL;
-	act_idx++;
+// Configure a flow queue and the template table for all flows (returns -1 if the port does not support it)
+int configure_async_flows(uint16_t portid)
+{
+	struct rte_flow_error err = {};
+	struct rte_flow_port_info port_info = {};
+	struct rte_flow_queue_info queue_info = {};
 
-	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_ETH;
-	pattern_idx++;
+	if (rte_flow_info_get(portid, &port_info, &queue_info, &err) != 0 || port_info.max_nb_queues == 0)
+	{
+		return -1;
+	}
 
-	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_IPV4;
-	pattern[pattern_idx].spec = &tcp_control_blocks[i].flow_ipv4;
-	pattern[pattern_idx].mask = &tcp_control_blocks[i].flow_ipv4_mask;
-	pattern_idx++;
+	// a single flow queue, used by the main lcore during the startup
+	struct rte_flow_port_attr port_attr = {};
+	struct rte_flow_queue_attr queue_attr = {.size = FLOW_ASYNC_QUEUE_SIZE};
+	const struct rte_flow_queue_attr *queue_attrs[] = {&queue_attr};
+	if (rte_flow_configure(portid, &port_attr, 1, queue_attrs, &err) != 0)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Flow configuration failed %s\n", err.message);
+		return -1;
+	}
 
-	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_TCP;
-	pattern[pattern_idx].spec = &tcp_control_blocks[i].flow_tcp;
-	pattern[pattern_idx].mask = &tcp_control_blocks[i].flow_tcp_mask;
-	pattern_idx++;
+	// match the exact addresses and ports of the responses
+	struct rte_flow_item_ipv4 ipv4_mask = {.hdr = {.src_addr = 0xFFFFFFFF, .dst_addr = 0xFFFFFFFF}};
+	struct rte_flow_item_tcp tcp_mask = {.hdr = {.src_port = 0xFFFF, .dst_port = 0xFFFF}};
+	struct rte_flow_item pattern[] = {
+			{.type = RTE_FLOW_ITEM_TYPE_ETH},
+			{.type = RTE_FLOW_ITEM_TYPE_IPV4, .mask = &ipv4_mask},
+			{.type = RTE_FLOW_ITEM_TYPE_TCP, .mask = &tcp_mask},
+			{.type = RTE_FLOW_ITEM_TYPE_END},
+	};
+	struct rte_flow_pattern_template_attr pattern_attr = {.relaxed_matching = 0, .ingress = 1};
+	pattern_template = rte_flow_pattern_template_create(portid, &pattern_attr, pattern, &err);
+	if (pattern_template == NULL)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Pattern template creation failed %s\n", err.message);
+		return -1;
+	}
 
-	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_END;
-	pattern_idx++;
+	// the mark and the queue are given per rule (masks without conf)
+	struct rte_flow_action_mark mark = {};
+	struct rte_flow_action_queue queue = {};
+	struct rte_flow_action actions[] = {
+			{.type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &queue},
+			{.type = RTE_FLOW_ACTION_TYPE_MARK, .conf = &mark},
+			{.type = RTE_FLOW_ACTION_TYPE_END},
+	};
+	struct rte_flow_action masks[] = {
+			{.type = RTE_FLOW_ACTION_TYPE_QUEUE},
+			{.type = RTE_FLOW_ACTION_TYPE_MARK},
+			{.type = RTE_FLOW_ACTION_TYPE_END},
+	};
+	struct rte_flow_actions_template_attr actions_attr = {.ingress = 1};
+	actions_template = rte_flow_actions_template_create(portid, &actions_attr, actions, masks, &err);
+	if (actions_template == NULL)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Actions template creation failed %s\n", err.message);
+		destroy_async_flows(portid);
+		return -1;
+	}
 
-	// validate the rte_flow
-	ret = rte_flow_validate(portid, &attr, pattern, action, &err);
-	if (ret < 0)
+	struct rte_flow_template_table_attr table_attr = {
+			.flow_attr = {.group = 0, .ingress = 1},
+			.nb_flows = nr_flows,
+	};
+	flow_table = rte_flow_template_table_create(portid, &table_attr, &pattern_template, 1, &actions_template, 1, &err);
+	if (flow_table == NULL)
 	{
-		RTE_LOG(ERR, LOAD_GENERATOR, "Flow validation failed %s\n", err.message);
-		return;
+		RTE_LOG(ERR, LOAD_GENERATOR, "Template table creation failed %s\n", err.message);
+		destroy_async_flows(portid);
+		return -1;
 	}
 
-	// create the flow and insert to the NIC
-	struct rte_flow *rule = rte_flow_create(portid, &attr, pattern, action, &err);
-	if (rule == NULL)
+	return 0;
+}
+
+// Wait until at most max_pending operations of the flow queue are left, returning -1 if any of them failed
+// (the failed operations are completed too, so a later drain does not wait for them)
+static int pull_async_flows(uint16_t portid, uint32_t *nb_pending, uint32_t max_pending)
+{
+	int ret = 0;
+	struct rte_flow_error err = {};
+	struct rte_flow_op_result results[FLOW_ASYNC_BURST];
+
+	while (*nb_pending > max_pending)
 	{
-		RTE_LOG(ERR, LOAD_GENERATOR, "Flow creation return %s\n", err.message);
+		int n = rte_flow_pull(portid, 0, results, FLOW_ASYNC_BURST, &err);
+		if (n < 0)
+		{
+			RTE_LOG(ERR, LOAD_GENERATOR, "Flow pull failed %s\n", err.message);
+			return -1;
+		}
+
+		*nb_pending -= n;
+		for (int j = 0; j < n; j++)
+		{
+			if (results[j].status != RTE_FLOW_OP_SUCCESS)
+			{
+				ret = -1;
+			}
+		}
 	}
+
+	return ret;
+}
+
+// Insert the rules of all flows through the flow queue, pushing them in bursts (returns -1 on any failure)
+int insert_flows_async(uint16_t portid)
+{
+	struct rte_flow_error err = {};
+	struct rte_flow_op_attr op_attr = {.postpone = 1};
+
+	// the items and actions of a rule stay untouched until its operation completes
+	flow_rule_t *rules = rte_malloc(NULL, FLOW_ASYNC_QUEUE_SIZE * sizeof(flow_rule_t), 64);
+	if (rules == NULL)
+	{
+		return -1;
+	}
+
+	int ret = 0;
+	uint32_t nb_pending = 0;
+	for (uint32_t i = 0; i < nr_flows && ret == 0; i++)
+	{
+		flow_rule_t *rule = &rules[i % FLOW_ASYNC_QUEUE_SIZE];
+		build_flow_rule(rule, i);
+
+		if (rte_flow_async_create(portid, 0, &op_attr, flow_table, rule->pattern, 0, rule->action, 0, NULL, &err) == NULL)
+		{
+			RTE_LOG(ERR, LOAD_GENERATOR, "Async flow creation failed %s\n", err.message);
+			ret = -1;
+			break;
+		}
+		nb_pending++;
+
+		// hand a burst of rules to the NIC and keep room in the flow queue
+		if ((i + 1) % FLOW_ASYNC_BURST == 0)
+		{
+			rte_flow_push(portid, 0, &err);
+			ret = pull_async_flows(portid, &nb_pending, FLOW_ASYNC_QUEUE_SIZE - FLOW_ASYNC_BURST);
+		}
+	}
+
+	// wait for the remaining rules (also after a failure, so none of them still uses the rules array)
+	rte_flow_push(portid, 0, &err);
+	if (pull_async_flows(portid, &nb_pending, 0) != 0)
+	{
+		ret = -1;
+	}
+
+	rte_free(rules);
+
+	return ret;
+}
+
+// Steer all responses from the server to the RX queues with a single rule (the software classifier finds the flows)
+int insert_wildcard_flow(uint16_t portid)
+{
+	struct rte_flow_attr attr = {.ingress = 1};
+	struct rte_flow_error err = {};
+
+	struct rte_flow_item_ipv4 ipv4 = {.hdr = {.src_addr = dst_ipv4_addr}};
+	struct rte_flow_item_ipv4 ipv4_mask = {.hdr = {.src_addr = 0xFFFFFFFF}};
+	struct rte_flow_item_tcp tcp = {.hdr = {.src_port = rte_cpu_to_be_16(dst_tcp_port)}};
+	struct rte_flow_item_tcp tcp_mask = {.hdr = {.src_port = 0xFFFF}};
+	struct rte_flow_item pattern[] = {
+			{.type = RTE_FLOW_ITEM_TYPE_ETH},
+			{.type = RTE_FLOW_ITEM_TYPE_IPV4, .spec = &ipv4, .mask = &ipv4_mask},
+			{.type = RTE_FLOW_ITEM_TYPE_TCP, .spec = &tcp, .mask = &tcp_mask},
+			{.type = RTE_FLOW_ITEM_TYPE_END},
+	};
+
+	// spread the flows over the RX queues by their 5-tuple (so each flow stays on one queue)
+	uint16_t queues[RTE_MAX_QUEUES_PER_PORT];
+	for (uint16_t q = 0; q < nr_rx_queues; q++)
+	{
+		queues[q] = q;
+	}
+	struct rte_flow_action_queue queue = {.index = 0};
+	struct rte_flow_action_rss rss = {
+			.func = RTE_ETH_HASH_FUNCTION_DEFAULT,
+			.types = RTE_ETH_RSS_NONFRAG_IPV4_TCP,
+			.queue_num = nr_rx_queues,
+			.queue = queues,
+	};
+	struct rte_flow_action action[] = {
+			{.type = nr_rx_queues > 1 ? RTE_FLOW_ACTION_TYPE_RSS : RTE_FLOW_ACTION_TYPE_QUEUE, .conf = nr_rx_queues > 1 ? (void *)&rss : (void *)&queue},
+			{.type = RTE_FLOW_ACTION_TYPE_END},
+	};
+
+	if (rte_flow_validate(portid, &attr, pattern, action, &err) < 0 || rte_flow_create(portid, &attr, pattern, action, &err) == NULL)
+	{
+		RTE_LOG(ERR, LOAD_GENERATOR, "Wildcard flow creation failed %s\n", err.message);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Build the software classifier with the 5-tuples of all flows (used when the NIC cannot tag them)
+void create_flow_classifier()
+{
+	if (nr_flows > CLASSIFIER_MAX_FLOWS)
+	{
+		rte_exit(EXIT_FAILURE, "The software classifier supports at most %u flows.\n", CLASSIFIER_MAX_FLOWS);
+	}
+
+	flow_classifier_table = classifier_create(nr_flows);
+	if (flow_classifier_table == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the flow classifier.\n");
+	}
+
+	// responses come from the server to the client
+	for (uint32_t i = 0; i < nr_flows; i++)
+	{
+		tcp_control_block_t *block = &tcp_control_blocks[i];
+		classifier_add(flow_classifier_table, block->dst_addr, block->src_addr, block->dst_port, block->src_port, i);
+	}
+
+	flow_classifier = CLASSIFIER_SOFTWARE;
 }
 
 // create a DPDK ring for the RX thread
@@ -281,9 +722,22 @@ void create_dpdk_ring()
 // clear all DPDK structures allocated
 void clean_hugepages()
 {
+	struct rte_flow_error err = {};
+
+	// the rules go before the template table they were created in
+	rte_flow_flush(0, &err);
+	destroy_async_flows(0);
+
 	rte_ring_free(rx_ring);
 
 	rte_free(tcp_control_blocks);
+	classifier_free(flow_classifier_table);
 	rte_mempool_free(pktmbuf_pool_rx);
 	rte_mempool_free(pktmbuf_pool_tx);
+	rte_mempool_free(pktmbuf_pool_gso);
+	rte_mempool_free(pktmbuf_pool_ext);
+	for (uint32_t i = 0; i < ZC_SHARED_BUFFERS; i++)
+	{
+		rte_free(shared_payloads[i]);
+	}
 }
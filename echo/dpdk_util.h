@@ -5,6 +5,7 @@
 #include <rte_ethdev.h>
 
 #include <rte_ip.h>
+#include <rte_gso.h>
 #include <rte_eal.h>
 #include <rte_log.h>
 #include <rte_tcp.h>
@@ -17,29 +18,74 @@
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
 #include <rte_mempool.h>
+#include <rte_mbuf_dyn.h>
 
 #include "tcp_util.h"
+#include "classifier.h"
 
 #define BURST_SIZE 32
 #define RING_ELEMENTS 32 * 1024
 #define MEMPOOL_CACHE_SIZE 512
 #define MAX_RTE_FLOW_PATTERN 4
 #define MAX_RTE_FLOW_ACTIONS 4
+#define FLOW_ASYNC_QUEUE_SIZE 1024
+#define FLOW_ASYNC_BURST 64
+#define GSO_MAX_SEGMENTS 128
+#define ZC_SHARED_BUFFERS 16
+#define ZC_HEADER_ROOM 128
 #define PKTMBUF_POOL_ELEMENTS 256 * 1024 - 1
 #define RTE_LOGTYPE_LOAD_GENERATOR RTE_LOGTYPE_USER1
 
+// Pattern and actions of the rte_flow rule of one flow (built from the control block when the rule is inserted)
+typedef struct flow_rule_t
+{
+	struct rte_flow_item_ipv4 ipv4;
+	struct rte_flow_item_ipv4 ipv4_mask;
+	struct rte_flow_item_tcp tcp;
+	struct rte_flow_item_tcp tcp_mask;
+	struct rte_flow_action_mark mark;
+	struct rte_flow_action_queue queue;
+	struct rte_flow_item pattern[MAX_RTE_FLOW_PATTERN];
+	struct rte_flow_action action[MAX_RTE_FLOW_ACTIONS];
+} flow_rule_t;
+
 extern uint32_t min_lcores;
+extern uint32_t nr_tx_lcores;
+extern uint32_t nr_rx_queues;
 extern uint64_t TICKS_PER_US;
 extern struct rte_mempool *pktmbuf_pool_rx;
 extern struct rte_mempool *pktmbuf_pool_tx;
 extern tcp_control_block_t *tcp_control_blocks;
 extern struct rte_ring *rx_ring;
+extern uint8_t flow_classifier;
+extern uint8_t flow_wildcard;
+extern uint16_t dst_tcp_port;
+extern uint32_t dst_ipv4_addr;
+extern int rx_tsc_dynfield;
 
 void clean_hugepages();
 void print_DPDK_stats();
-void insert_flow(uint16_t portid, uint32_t i);
+int insert_flow(uint16_t portid, uint32_t i);
+void create_flow_classifier();
+int configure_async_flows(uint16_t portid);
+int insert_flows_async(uint16_t portid);
+int insert_wildcard_flow(uint16_t portid);
 void init_DPDK(uint16_t portid, uint32_t seed);
 void create_dpdk_ring();
+void attach_shared_payload(struct rte_mbuf *pkt, uint32_t len);
+void send_pkts(uint16_t portid, uint16_t qid, struct rte_mbuf **pkts, uint16_t nb_pkts);
 int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue);
 
+// Keep the receive time of the packet in its mbuf (the RX path never writes the payload, which the response framing reads)
+static inline void set_rx_tsc(struct rte_mbuf *pkt, uint64_t tsc)
+{
+	*RTE_MBUF_DYNFIELD(pkt, rx_tsc_dynfield, uint64_t *) = tsc;
+}
+
+// Receive time of the packet
+static inline uint64_t get_rx_tsc(struct rte_mbuf *pkt)
+{
+	return *RTE_MBUF_DYNFIELD(pkt, rx_tsc_dynfield, uint64_t *);
+}
+
 #endif // __DPDK_UTIL_H__
@@ -0,0 +1,138 @@
+#ifndef __HEADER_H__
+#define __HEADER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+
+#define HEADER_LEGACY 0
+#define HEADER_COMPACT 1
+#define LEGACY_HEADER_SIZE 48
+#define COMPACT_VERSION 1
+#define COMPACT_BASE_SIZE 6
+#define COMPACT_RETRANSMISSION 0x02
+#define COMPACT_SIZE 0x04
+#define COMPACT_WORK 0x08
+#define COMPACT_SIZE_CLASS_SHIFT 24
+
+// Fields of a request header, echoed back in its response, whatever the wire layout
+// (tag is the flow id, response size, size class, and retransmission flag, laid out as in request_tag)
+typedef struct wire_header_t
+{
+	uint64_t t0;
+	uint64_t tag;
+	uint64_t worker_id;
+	uint64_t iterations;
+	uint64_t randomness;
+} wire_header_t;
+
+extern uint8_t header_layout;
+extern uint8_t compact_flags;
+extern uint32_t header_size;
+
+void fill_payload_pkt(struct rte_mbuf *pkt, const wire_header_t *header);
+
+// Length of a compact header with the optional fields of the flags
+static inline uint32_t compact_header_size(uint8_t flags)
+{
+	return COMPACT_BASE_SIZE + ((flags & COMPACT_SIZE) ? 4 : 0) + ((flags & COMPACT_WORK) ? 8 : 0);
+}
+
+// Bytes of the header echoed at the start of each response
+static inline uint32_t response_header_size()
+{
+	return header_layout == HEADER_LEGACY ? RESPONSE_HEADER_SIZE : header_size;
+}
+
+// Write the header at the start of the request payload
+// legacy: six 64-bit words (send time, RX time slot, tag, worker id slot, iterations, randomness)
+// compact v1: version and flags (1 B), worker id slot (1 B), and low 32 bits of the send TSC, then the optional
+// response size and size class (32 bits) and the server work (32-bit iterations and randomness)
+// (no flow id: the RX already knows the flow of each segment from the flow classifier)
+static inline void header_write(uint8_t *payload, const wire_header_t *h)
+{
+	if (header_layout == HEADER_LEGACY)
+	{
+		((uint64_t *)payload)[0] = h->t0;
+		((uint64_t *)payload)[2] = h->tag;
+		((uint64_t *)payload)[4] = h->iterations;
+		((uint64_t *)payload)[5] = h->randomness;
+		return;
+	}
+
+	uint8_t flags = compact_flags | ((h->tag & RETRANSMISSION_FLAG) ? COMPACT_RETRANSMISSION : 0);
+	uint32_t tsc = (uint32_t)h->t0;
+	uint32_t off = COMPACT_BASE_SIZE;
+
+	payload[0] = (COMPACT_VERSION << 4) | flags;
+	payload[1] = 0;
+	memcpy(payload + 2, &tsc, sizeof(uint32_t));
+
+	if (flags & COMPACT_SIZE)
+	{
+		uint32_t size = ((h->tag >> RESPONSE_SIZE_SHIFT) & RESPONSE_SIZE_MASK) | (((h->tag >> SIZE_CLASS_SHIFT) & SIZE_CLASS_MASK) << COMPACT_SIZE_CLASS_SHIFT);
+		memcpy(payload + off, &size, sizeof(uint32_t));
+		off += 4;
+	}
+
+	if (flags & COMPACT_WORK)
+	{
+		uint32_t work[2] = {(uint32_t)h->iterations, (uint32_t)h->randomness};
+		memcpy(payload + off, work, sizeof(work));
+	}
+}
+
+// Read the header echoed at the start of a response of the flow with len readable bytes and received at t1
+// (0 if it is cut or unknown)
+static inline uint32_t header_read(const uint8_t *payload, uint32_t len, uint64_t t1, uint32_t flow_id, wire_header_t *h)
+{
+	if (header_layout == HEADER_LEGACY)
+	{
+		if (len < RESPONSE_HEADER_SIZE)
+		{
+			return 0;
+		}
+		h->t0 = ((const uint64_t *)payload)[0];
+		h->tag = ((const uint64_t *)payload)[2];
+		h->worker_id = ((const uint64_t *)payload)[3];
+		return RESPONSE_HEADER_SIZE;
+	}
+
+	if (len < COMPACT_BASE_SIZE || (payload[0] >> 4) != COMPACT_VERSION)
+	{
+		return 0;
+	}
+	uint8_t flags = payload[0] & 0x0f;
+	uint32_t size = compact_header_size(flags);
+	if (len < size)
+	{
+		return 0;
+	}
+
+	// the send time is recovered as a 32-bit delta before the receive time
+	uint32_t tsc;
+	memcpy(&tsc, payload + 2, sizeof(uint32_t));
+	h->t0 = t1 - (uint32_t)((uint32_t)t1 - tsc);
+	h->worker_id = payload[1];
+	h->tag = flow_id;
+
+	uint32_t off = COMPACT_BASE_SIZE;
+
+	// without the size field the responses have the constant size of the run (0 in the tag)
+	if (flags & COMPACT_SIZE)
+	{
+		uint32_t resp;
+		memcpy(&resp, payload + off, sizeof(uint32_t));
+		h->tag |= ((uint64_t)(resp & RESPONSE_SIZE_MASK) << RESPONSE_SIZE_SHIFT) | ((uint64_t)(resp >> COMPACT_SIZE_CLASS_SHIFT) << SIZE_CLASS_SHIFT);
+	}
+
+	if (flags & COMPACT_RETRANSMISSION)
+	{
+		h->tag |= RETRANSMISSION_FLAG;
+	}
+
+	return size;
+}
+
+#endif // __HEADER_H__
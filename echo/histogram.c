@@ -0,0 +1,111 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_eal.h>
+
+#include "histogram.h"
+
+// Create an empty histogram keeping the given number of significant decimal digits
+histogram_t *histogram_create(uint32_t digits)
+{
+	histogram_t *h = (histogram_t *)rte_zmalloc(NULL, sizeof(histogram_t), 64);
+	if (h == NULL)
+	{
+		return NULL;
+	}
+
+	// the relative error of a sub-bucket is 2^-(sub_bucket_bits-1), i.e., below 10^-digits
+	h->sub_bucket_bits = (uint32_t)ceil(log2(2 * pow(10, digits)));
+	h->nr_buckets = (64 - h->sub_bucket_bits + 2) << (h->sub_bucket_bits - 1);
+	h->counts = (uint64_t *)rte_zmalloc(NULL, h->nr_buckets * sizeof(uint64_t), 64);
+	if (h->counts == NULL)
+	{
+		histogram_free(h);
+		return NULL;
+	}
+	histogram_reset(h);
+
+	return h;
+}
+
+// Discard all values counted so far
+void histogram_reset(histogram_t *h)
+{
+	memset(h->counts, 0, h->nr_buckets * sizeof(uint64_t));
+	h->total = 0;
+	h->min = UINT64_MAX;
+	h->max = 0;
+}
+
+// Add the counts of src (same precision) into dst
+void histogram_merge(histogram_t *dst, const histogram_t *src)
+{
+	for (uint32_t idx = 0; idx < dst->nr_buckets; idx++)
+	{
+		dst->counts[idx] += src->counts[idx];
+	}
+
+	dst->total += src->total;
+	dst->min = src->min < dst->min ? src->min : dst->min;
+	dst->max = src->max > dst->max ? src->max : dst->max;
+}
+
+// Highest value equivalent to the bucket
+static uint64_t histogram_bucket_value(const histogram_t *h, uint32_t idx)
+{
+	if (idx < (1U << h->sub_bucket_bits))
+	{
+		return idx;
+	}
+
+	uint32_t shift = (idx >> (h->sub_bucket_bits - 1)) - 1;
+	uint64_t sub_bucket = idx - (shift << (h->sub_bucket_bits - 1));
+
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+// Value of the rank-th smallest count (1-based), or UINT64_MAX when there are fewer values
+uint64_t histogram_value_at_rank(const histogram_t *h, uint64_t rank)
+{
+	if (rank == 0 || rank > h->total)
+	{
+		return UINT64_MAX;
+	}
+
+	uint64_t seen = 0;
+	for (uint32_t idx = 0; idx < h->nr_buckets; idx++)
+	{
+		seen += h->counts[idx];
+		if (seen >= rank)
+		{
+			uint64_t value = histogram_bucket_value(h, idx);
+			return value < h->max ? value : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+// Value below which the percentile of the counts falls (0 for an empty histogram)
+uint64_t histogram_percentile(const histogram_t *h, double percentile)
+{
+	if (h->total == 0)
+	{
+		return 0;
+	}
+
+	return histogram_value_at_rank(h, (uint64_t)((percentile / 100.0) * (h->total - 1)) + 1);
+}
+
+// Release the histogram
+void histogram_free(histogram_t *h)
+{
+	if (h == NULL)
+	{
+		return;
+	}
+
+	rte_free(h->counts);
+	rte_free(h);
+}
@@ -0,0 +1,53 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+
+#include <rte_malloc.h>
+
+#define HISTOGRAM_MIN_DIGITS 1
+#define HISTOGRAM_MAX_DIGITS 5
+
+// Log-linear (HDR-style) histogram of values in ns: exact below 2^sub_bucket_bits,
+// then every power of two is split into 2^(sub_bucket_bits-1) linear sub-buckets
+typedef struct histogram_t
+{
+	uint32_t sub_bucket_bits;
+	uint32_t nr_buckets;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t *counts;
+} histogram_t;
+
+histogram_t *histogram_create(uint32_t digits);
+void histogram_reset(histogram_t *h);
+void histogram_merge(histogram_t *dst, const histogram_t *src);
+uint64_t histogram_value_at_rank(const histogram_t *h, uint64_t rank);
+uint64_t histogram_percentile(const histogram_t *h, double percentile);
+void histogram_free(histogram_t *h);
+
+// Index of the bucket that holds the value
+static inline uint32_t histogram_index(const histogram_t *h, uint64_t value)
+{
+	if (value < (1ULL << h->sub_bucket_bits))
+	{
+		return (uint32_t)value;
+	}
+
+	// keep the sub_bucket_bits most significant bits of the value
+	uint32_t shift = (63 - __builtin_clzll(value)) - h->sub_bucket_bits + 1;
+
+	return (shift << (h->sub_bucket_bits - 1)) + (uint32_t)(value >> shift);
+}
+
+// Count one value (only a single lcore records into a histogram)
+static inline void histogram_record(histogram_t *h, uint64_t value)
+{
+	h->counts[histogram_index(h, value)]++;
+	h->total++;
+	h->min = value < h->min ? value : h->min;
+	h->max = value > h->max ? value : h->max;
+}
+
+#endif // __HISTOGRAM_H__
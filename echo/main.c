@@ -9,9 +9,15 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "rng.h"
+#include "histogram.h"
+#include "writer.h"
+#include "telemetry.h"
+#include "timer_wheel.h"
 #include "util.h"
 #include "tcp_util.h"
 #include "dpdk_util.h"
+#include "header.h"
 
 #define PKT_RX_RSS_HASH (1ULL << 1)
 #define PKT_RX_FDIR (1ULL << 2)
@@ -20,35 +26,89 @@
 uint64_t rate;
 uint32_t seed;
 uint64_t duration;
+uint64_t nr_elements;
+uint32_t nr_phases;
+phase_t phases[MAX_PHASES];
 uint64_t nr_flows;
 uint32_t min_lcores;
 uint32_t frame_size;
+uint32_t nr_tx_lcores = 1;
+uint32_t nr_rx_queues = 1;
+uint8_t rx_inline = 0;
+uint32_t handshake_window = HANDSHAKE_WINDOW;
+uint64_t rto_us = 0;
+uint8_t flow_classifier = CLASSIFIER_RTE_FLOW;
+uint8_t flow_wildcard = 0;
+classifier_t *flow_classifier_table;
+uint64_t tx_batch_window = 0;
+uint8_t stream_schedule = 0;
+uint32_t closed_loop_window = 0;
+double think_time = 0;
+double slo_percentile = 0;
+uint8_t live_stats = 0;
+uint32_t histogram_digits = 3;
+uint64_t slo_latency = 0;
 uint32_t tcp_payload_size;
+uint32_t tcp_mss = DEFAULT_MSS;
+uint8_t header_layout = HEADER_LEGACY;
+uint8_t compact_flags = 0;
+uint32_t header_size = LEGACY_HEADER_SIZE;
+int rx_tsc_dynfield = -1;
+uint8_t tx_segmentation = TX_SEG_NONE;
+uint8_t zero_copy = 0;
 
 // General variables
 uint64_t TICKS_PER_US = 0;
-uint16_t *flow_indexes_array;
-uint32_t *interarrival_array;
-application_node_t *application_array;
+uint64_t tx_start_tsc;
+uint32_t *flow_indexes_array;
+uint64_t *interarrival_array;
+schedule_chunk_t schedule_array_chunks[RTE_MAX_LCORE];
 
 // Heap and DPDK allocated
-uint32_t incoming_idx;
-node_t *incoming_array;
+histogram_t *latency_histograms[MAX_PHASES];
+rx_results_t rx_results[RTE_MAX_LCORE];
+deferred_queue_t *deferred_queues[RTE_MAX_LCORE];
+writer_t *bin_writer;
 struct rte_mempool *pktmbuf_pool_rx;
 struct rte_mempool *pktmbuf_pool_tx;
+struct rte_mempool *schedule_pool;
+struct rte_ring *schedule_rings[RTE_MAX_LCORE];
+struct rte_ring *completion_rings[RTE_MAX_LCORE];
 tcp_control_block_t *tcp_control_blocks;
 
 // Internal threads variables
 uint8_t quit_rx = 0;
 uint8_t quit_tx = 0;
 uint8_t quit_rx_ring = 0;
+uint8_t schedule_done = 0;
 uint32_t nr_never_sent = 0;
 struct rte_ring *rx_ring;
+tx_batch_stats_t tx_batch_stats[RTE_MAX_LCORE];
+lcore_counters_t lcore_counters[RTE_MAX_LCORE];
+
+// Burst of packets whose deadlines fall within the TX batching window
+typedef struct tx_burst_s
+{
+	uint16_t nb_pkts;
+	uint64_t deadlines[BURST_SIZE];
+	struct rte_mbuf *pkts[BURST_SIZE];
+	tcp_control_block_t *blocks[BURST_SIZE];
+} tx_burst_t;
+
+// Request waiting for its think time to expire (closed-loop mode)
+typedef struct pending_request_s
+{
+	uint64_t deadline;
+	uint32_t flow_id;
+} pending_request_t;
 
 // Connection variables
 uint16_t dst_tcp_port;
 uint32_t dst_ipv4_addr;
 uint32_t src_ipv4_addr;
+uint32_t src_ipv4_count = 1;
+uint16_t src_tcp_port_min = 1;
+uint16_t src_tcp_port_max = UINT16_MAX;
 struct rte_ether_addr dst_eth_addr;
 struct rte_ether_addr src_eth_addr;
 
@@ -84,8 +144,84 @@ static inline void calibrate_tsc(void)
 	TICKS_PER_US = tsc / freq;
 }
 
-// Process the incoming TCP packet
-int process_rx_pkt(struct rte_mbuf *pkt, node_t *incoming, uint32_t *incoming_idx)
+// Count responses of the flow as lost (in closed loop, their slots go back to the TX lcore as if they were answered)
+static inline void count_lost(rx_results_t *results, uint32_t flow_id, uint64_t n)
+{
+	results->lost += n;
+	if (closed_loop_window > 0)
+	{
+		for (uint64_t i = 0; i < n; i++)
+		{
+			rte_ring_enqueue_elem(completion_rings[flow_id % nr_tx_lcores], &flow_id, sizeof(uint32_t));
+		}
+	}
+}
+
+// Record one complete response (its header segment gives the send time, the segment with its last byte the receive time)
+static int record_response(rx_results_t *results, uint32_t flow_id, uint32_t qid, uint64_t t0, uint64_t t1, uint64_t f_id, uint64_t w_id)
+{
+	// hand the completion back to the TX lcore that owns the flow
+	if (closed_loop_window > 0)
+	{
+		rte_ring_enqueue_elem(completion_rings[flow_id % nr_tx_lcores], &flow_id, sizeof(uint32_t));
+	}
+
+	// responses to retransmitted requests are counted apart (the send time of the lost original is unknown)
+	if (unlikely(f_id & RETRANSMISSION_FLAG))
+	{
+		results->retransmitted++;
+		return 0;
+	}
+
+	// responses to requests sent before the run (or the current probe) are not counted
+	if (unlikely(t0 < phases[0].start_tsc))
+	{
+		return 0;
+	}
+
+	// a size class out of range comes from a corrupted header (counted as a lost response)
+	uint32_t c = (f_id >> SIZE_CLASS_SHIFT) & SIZE_CLASS_MASK;
+	if (unlikely(c >= SIZE_CLASSES))
+	{
+		results->lost++;
+		return 0;
+	}
+
+	// count the RTT latency (ns) in the histogram of the phase
+	uint64_t latency = (uint64_t)((t1 - t0) / ((double)TICKS_PER_US / 1000));
+	histogram_record(results->histograms[find_phase(t0)], latency);
+
+	// and in the histogram of its size class (only when the sizes vary)
+	histogram_t *size_histogram = results->size_histograms[c];
+	if (size_histogram)
+	{
+		histogram_record(size_histogram, latency);
+	}
+
+	// stream the response to the binary output
+	if (bin_writer)
+	{
+		writer_record(bin_writer, qid, t0, latency, (uint32_t)f_id);
+	}
+
+	// per-packet capture is disabled (no output file) or the incoming array is full
+	if (unlikely(results->incoming_idx >= results->incoming_capacity))
+	{
+		return 0;
+	}
+
+	// fill the node previously allocated
+	node_t *node = &results->incoming_array[results->incoming_idx++];
+	node->timestamp_tx = t0;
+	node->timestamp_rx = t1;
+	node->flow_id = f_id & FLOW_ID_MASK;
+	node->worker_id = w_id;
+
+	return 1;
+}
+
+// Process the incoming TCP packet (responses are framed over the byte stream of their flow by the size in their header)
+int process_rx_pkt(struct rte_mbuf *pkt, rx_results_t *results, uint32_t qid)
 {
 	// process only TCP packets
 	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
@@ -108,21 +244,32 @@ int process_rx_pkt(struct rte_mbuf *pkt, node_t *incoming, uint32_t *incoming_id
 		return 0;
 	}
 
-	// obtain both timestamps from the packet
-	uint64_t *payload = (uint64_t *)(((uint8_t *)tcp_hdr) + tcp_hdr_len);
-	uint64_t t0 = payload[0];
-	uint64_t t1 = payload[1];
-	uint64_t f_id = payload[2];
-	uint64_t w_id = payload[3];
+	// the RX lcore kept the receive time in the mbuf
+	uint8_t *payload = ((uint8_t *)tcp_hdr) + tcp_hdr_len;
+	uint64_t t1 = get_rx_tsc(pkt);
+
+	// only the first mbuf is inspected, so a header must lie entirely in it
+	uint32_t readable = RTE_MIN(packet_data_size, rte_pktmbuf_data_len(pkt) - (uint32_t)(payload - rte_pktmbuf_mtod(pkt, uint8_t *)));
 
 	// retrieve the index of the flow from the NIC (NIC tags the packet according the 5-tuple using DPDK rte_flow)
 	uint32_t flow_id = pkt->hash.fdir.hi;
+	if (unlikely(flow_id >= nr_flows))
+	{
+		return 0;
+	}
 
 	// get control block for the flow
 	tcp_control_block_t *block = &tcp_control_blocks[flow_id];
 
-	// update receive window from the packet
-	rte_atomic16_set(&block->tcb_rwin, tcp_hdr->rx_win);
+	// update receive window from the packet (scaled by the shift of the SYN+ACK)
+	rte_atomic32_set(&block->tcb_rwin, (uint32_t)rte_be_to_cpu_16(tcp_hdr->rx_win) << block->snd_wscale);
+
+	// the server acknowledged more requests (the TX retransmits from the oldest unacked SEQ)
+	uint32_t ack = tcp_hdr->recv_ack;
+	if (SEQ_LT(rte_be_to_cpu_32(block->last_ack_recv), rte_be_to_cpu_32(ack)))
+	{
+		__atomic_store_n(&block->last_ack_recv, ack, __ATOMIC_RELAXED);
+	}
 
 	// do not process retransmitted packets
 	uint32_t seq = rte_be_to_cpu_32(tcp_hdr->sent_seq);
@@ -135,8 +282,55 @@ int process_rx_pkt(struct rte_mbuf *pkt, node_t *incoming, uint32_t *incoming_id
 		return 0;
 	}
 
-	// update ACK number in the TCP control block from the packet
+	// bytes of the segment already received (a retransmission overlapping the stream) are skipped
 	uint32_t ack_cur = rte_be_to_cpu_32(rte_atomic32_read(&block->tcb_next_ack));
+	uint32_t pos = 0;
+	if (unlikely(SEQ_LT(seq, ack_cur)))
+	{
+		pos = ack_cur - seq;
+		if (pos >= packet_data_size)
+		{
+			return 0;
+		}
+	}
+
+	// a hole before this segment means that the responses ending in it were lost (our ACK covers them, so they never come back)
+	uint64_t frame_off = block->rx_frame_off;
+	uint32_t frame_len = block->rx_frame_len;
+	if (unlikely(SEQ_LT(ack_cur, seq)))
+	{
+		uint32_t hole = seq - ack_cur;
+		block->rx_header_valid = 0;
+		if (response_sizes.min == response_sizes.max)
+		{
+			// all responses have the same size, so the framing goes on across the hole
+			frame_len = response_sizes.min;
+			frame_off += hole;
+			count_lost(results, flow_id, frame_off / frame_len);
+			frame_off %= frame_len;
+		}
+		else if (frame_off > 0 && frame_off + hole < frame_len)
+		{
+			// the hole is inside the response in progress
+			frame_off += hole;
+		}
+		else
+		{
+			// the sizes of the responses in the hole are unknown, so the framing starts again with this segment (lower bound of the lost ones)
+			if (frame_off > 0)
+			{
+				count_lost(results, flow_id, 1);
+				hole -= frame_len - frame_off;
+			}
+			if (hole > 0)
+			{
+				count_lost(results, flow_id, 1);
+			}
+			frame_off = 0;
+		}
+	}
+
+	// update ACK number in the TCP control block from the packet
 	uint32_t ack_hdr = seq + packet_data_size;
 	if (likely(SEQ_LEQ(ack_cur, ack_hdr)))
 	{
@@ -144,27 +338,117 @@ int process_rx_pkt(struct rte_mbuf *pkt, node_t *incoming, uint32_t *incoming_id
 		rte_atomic32_set(&block->tcb_next_ack, acked);
 	}
 
-	// fill the node previously allocated
-	node_t *node = &incoming[(*incoming_idx)++];
-	node->timestamp_tx = t0;
-	node->timestamp_rx = t1;
-	node->flow_id = f_id;
-	node->worker_id = w_id;
+	int recorded = 0;
 
-	return 1;
+	// the response in progress ends in this segment (its header came in an earlier one)
+	if (frame_off > 0)
+	{
+		uint32_t left = frame_len - frame_off;
+		if (pos + left > packet_data_size)
+		{
+			block->rx_frame_off = frame_off + packet_data_size - pos;
+			block->rx_frame_len = frame_len;
+			return 0;
+		}
+		pos += left;
+
+		if (likely(block->rx_header_valid))
+		{
+			recorded += record_response(results, flow_id, qid, block->rx_t0, t1, block->rx_f_id, block->rx_w_id);
+		}
+		else
+		{
+			count_lost(results, flow_id, 1);
+		}
+		block->rx_header_valid = 0;
+	}
+
+	// responses starting in this segment (several when the server coalesces them)
+	while (pos < packet_data_size)
+	{
+		wire_header_t header;
+		uint8_t header_valid = header_read(payload + pos, pos < readable ? readable - pos : 0, t1, flow_id, &header) > 0;
+
+		// the size of the response is echoed in its header (a cut header with varying sizes ends the response with the segment)
+		frame_len = 0;
+		if (likely(header_valid))
+		{
+			frame_len = (header.tag >> RESPONSE_SIZE_SHIFT) & RESPONSE_SIZE_MASK;
+		}
+		if (frame_len == 0)
+		{
+			frame_len = response_sizes.min == response_sizes.max ? response_sizes.min : packet_data_size - pos;
+		}
+		if (unlikely(frame_len < response_header_size()))
+		{
+			frame_len = packet_data_size - pos;
+			header_valid = 0;
+		}
+
+		// the whole response is in this segment
+		if (pos + frame_len <= packet_data_size)
+		{
+			if (likely(header_valid))
+			{
+				recorded += record_response(results, flow_id, qid, header.t0, t1, header.tag, header.worker_id);
+			}
+			else
+			{
+				count_lost(results, flow_id, 1);
+			}
+			pos += frame_len;
+			continue;
+		}
+
+		// keep the header until the segment with the last byte arrives
+		block->rx_header_valid = header_valid;
+		if (likely(header_valid))
+		{
+			block->rx_t0 = header.t0;
+			block->rx_f_id = header.tag;
+			block->rx_w_id = header.worker_id;
+		}
+		block->rx_frame_off = packet_data_size - pos;
+		block->rx_frame_len = frame_len;
+
+		return recorded;
+	}
+
+	block->rx_frame_off = 0;
+
+	return recorded;
 }
 
-// Start the client establishing all TCP connections
+// Send a burst of handshake packets on the first TX queue (the TX lcores are not running yet), failing when the queue
+// makes no progress for a whole handshake timeout (e.g., the link is down)
+static void send_handshake_pkts(uint16_t portid, struct rte_mbuf **pkts, uint16_t nb_pkts)
+{
+	uint16_t nb_tx = 0;
+	uint64_t timeout_tsc = rte_rdtsc() + HANDSHAKE_TIMEOUT_IN_US * TICKS_PER_US;
+	while (nb_tx < nb_pkts)
+	{
+		uint16_t n = rte_eth_tx_burst(portid, 0, &pkts[nb_tx], nb_pkts - nb_tx);
+		if (n > 0)
+		{
+			nb_tx += n;
+			timeout_tsc = rte_rdtsc() + HANDSHAKE_TIMEOUT_IN_US * TICKS_PER_US;
+		}
+		else if (rte_rdtsc() > timeout_tsc)
+		{
+			rte_exit(EXIT_FAILURE, "Error to send the TCP handshake packets.\n");
+		}
+	}
+}
+
+// Start the client establishing all TCP connections (up to handshake_window SYNs in flight)
 void start_client(uint16_t portid)
 {
 	uint16_t nb_rx;
-	uint16_t nb_tx;
-	uint64_t ts_syn;
+	uint16_t nb_out;
 	struct rte_mbuf *pkt;
 	struct rte_flow_error err;
-	tcp_control_block_t *block;
-	uint32_t nb_retransmission;
 	struct rte_mbuf *pkts[BURST_SIZE];
+	struct rte_mbuf *out[BURST_SIZE];
 
 	// flush all flow rules
 	int ret = rte_flow_flush(portid, &err);
@@ -173,74 +457,139 @@ void start_client(uint16_t portid)
 		rte_exit(EXIT_FAILURE, "Cannot flush all rules associated with a port=%d\n", portid);
 	}
 
-	for (int i = 0; i < nr_flows; i++)
+	// classify the responses in software from the start (behind a single wildcard rule if the async flow API failed)
+	if (flow_classifier == CLASSIFIER_SOFTWARE)
 	{
-		// get the TCP control block for the flow
-		block = &tcp_control_blocks[i];
-		// create the TCP SYN packet
-		struct rte_mbuf *syn_packet = create_syn_packet(i);
-		// insert the rte_flow in the NIC to retrieve the flow id for incoming packets of this flow
-		insert_flow(portid, i);
+		if (flow_wildcard && insert_wildcard_flow(portid) != 0)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot insert the wildcard flow rule on port=%d\n", portid);
+		}
+		create_flow_classifier();
+	}
 
-		// send the SYN packet
-		struct rte_mbuf *syn_cloned = rte_pktmbuf_clone(syn_packet, pktmbuf_pool_tx);
-		nb_tx = rte_eth_tx_burst(portid, 0, &syn_cloned, 1);
-		if (nb_tx != 1)
+	// insert the rte_flow in the NIC to retrieve the flow id for incoming packets of each flow
+	uint64_t rules_tsc = rte_rdtsc();
+	if (flow_classifier == CLASSIFIER_ASYNC && insert_flows_async(portid) != 0)
+	{
+		// fall back to a single wildcard rule and the software classifier
+		printf("async rte_flow rules rejected, falling back to a wildcard rule and the software classifier\n");
+		rte_flow_flush(portid, &err);
+		if (insert_wildcard_flow(portid) != 0)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot insert the wildcard flow rule on port=%d\n", portid);
+		}
+		create_flow_classifier();
+	}
+	for (uint32_t i = 0; i < nr_flows && flow_classifier == CLASSIFIER_RTE_FLOW; i++)
+	{
+		if (insert_flow(portid, i) != 0)
 		{
-			rte_exit(EXIT_FAILURE, "Error to send the TCP SYN packet.\n");
+			// the NIC cannot tag the flows, so classify all of them in software
+			printf("rte_flow rule of flow %u rejected, falling back to the software classifier\n", i);
+			rte_flow_flush(portid, &err);
+			create_flow_classifier();
 		}
+	}
+	if (flow_classifier != CLASSIFIER_SOFTWARE)
+	{
+		double rules_ms = (double)(rte_rdtsc() - rules_tsc) / (TICKS_PER_US * 1000);
+		printf("installed %lu rte_flow rules in %.2f ms (%.0f rules/s)\n", nr_flows, rules_ms, nr_flows / (rules_ms / 1000));
+	}
 
-		// clear the counters
-		nb_retransmission = 1;
-		ts_syn = rte_rdtsc();
+	// flows with a SYN in flight, and when and how many times their SYN was sent (sized by the window, not by the flows)
+	uint32_t window = RTE_MIN(handshake_window, (uint32_t)nr_flows);
+	handshake_slot_t *in_flight = (handshake_slot_t *)rte_malloc(NULL, window * sizeof(handshake_slot_t), 64);
+	if (in_flight == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the handshake state.\n");
+	}
 
-		// change the TCP state to SYN_SENT
-		rte_atomic16_set(&block->tcb_state, TCP_SYN_SENT);
+	uint32_t next_flow = 0;
+	uint32_t nb_in_flight = 0;
+	uint32_t nb_established = 0;
+	uint64_t start_tsc = rte_rdtsc();
 
-		// while not received SYN+ACK packet and TCP state is not ESTABLISHED
-		while (rte_atomic16_read(&block->tcb_state) != TCP_ESTABLISHED)
+	while (nb_established < nr_flows)
+	{
+		// open new connections until the window is full
+		nb_out = 0;
+		while (nb_in_flight < window && next_flow < nr_flows)
 		{
-			// receive TCP SYN+ACK packets from the NIC
-			nb_rx = rte_eth_rx_burst(portid, 0, pkts, BURST_SIZE);
+			rte_atomic16_set(&tcp_control_blocks[next_flow].tcb_state, TCP_SYN_SENT);
+			in_flight[nb_in_flight].flow = next_flow;
+			in_flight[nb_in_flight].ts_syn = rte_rdtsc();
+			in_flight[nb_in_flight++].nb_syn = 1;
+			out[nb_out++] = create_syn_packet(next_flow++);
+			if (nb_out == BURST_SIZE)
+			{
+				send_handshake_pkts(portid, out, nb_out);
+				nb_out = 0;
+			}
+		}
+		send_handshake_pkts(portid, out, nb_out);
 
+		// receive TCP SYN+ACK packets of any flow from the NIC (on the RX queue of the flow)
+		for (uint16_t q = 0; q < nr_rx_queues; q++)
+		{
+			nb_rx = rte_eth_rx_burst(portid, q, pkts, BURST_SIZE);
+			if (flow_classifier == CLASSIFIER_SOFTWARE)
+			{
+				classifier_lookup_bulk(flow_classifier_table, pkts, nb_rx);
+			}
+
+			// process the SYN+ACK packets, sending the ACK packets to the server in one burst
+			nb_out = 0;
 			for (int j = 0; j < nb_rx; j++)
 			{
-				// process the SYN+ACK packet, returning the ACK packet to send
 				pkt = process_syn_ack_packet(pkts[j]);
-
 				if (pkt)
 				{
-					// send the TCP ACK packet to the server
-					nb_tx = rte_eth_tx_burst(portid, 0, &pkt, 1);
-					if (nb_tx != 1)
-					{
-						rte_exit(EXIT_FAILURE, "Error to send the TCP ACK packet.\n");
-					}
+					out[nb_out++] = pkt;
 				}
 			}
+			send_handshake_pkts(portid, out, nb_out);
+
 			// free packets
 			rte_pktmbuf_free_bulk(pkts, nb_rx);
+		}
 
-			if ((rte_rdtsc() - ts_syn) > (nb_retransmission * HANDSHAKE_TIMEOUT_IN_US) * TICKS_PER_US)
+		// retire the established flows and retransmit the SYNs whose timer expired
+		uint64_t now = rte_rdtsc();
+		nb_out = 0;
+		for (uint32_t k = 0; k < nb_in_flight;)
+		{
+			handshake_slot_t *slot = &in_flight[k];
+			if (rte_atomic16_read(&tcp_control_blocks[slot->flow].tcb_state) == TCP_ESTABLISHED)
 			{
-				nb_retransmission++;
-				syn_cloned = rte_pktmbuf_clone(syn_packet, pktmbuf_pool_tx);
-				nb_tx = rte_eth_tx_burst(portid, 0, &syn_cloned, 1);
-				if (nb_tx != 1)
-				{
-					rte_exit(EXIT_FAILURE, "Error to send the TCP SYN packet.\n");
-				}
-				ts_syn = rte_rdtsc();
+				in_flight[k] = in_flight[--nb_in_flight];
+				nb_established++;
+				continue;
+			}
 
-				if (nb_retransmission == HANDSHAKE_RETRANSMISSION)
+			if ((now - slot->ts_syn) > (slot->nb_syn * HANDSHAKE_TIMEOUT_IN_US) * TICKS_PER_US)
+			{
+				if (++slot->nb_syn == HANDSHAKE_RETRANSMISSION)
 				{
 					rte_exit(EXIT_FAILURE, "Cannot establish connection.\n");
 				}
+				slot->ts_syn = now;
+				out[nb_out++] = create_syn_packet(slot->flow);
+				if (nb_out == BURST_SIZE)
+				{
+					send_handshake_pkts(portid, out, nb_out);
+					nb_out = 0;
+				}
 			}
+			k++;
 		}
-		rte_pktmbuf_free(syn_packet);
+		send_handshake_pkts(portid, out, nb_out);
 	}
 
+	printf("established %lu connections in %.2f ms (window = %u)\n",
+				 nr_flows, (double)(rte_rdtsc() - start_tsc) / (TICKS_PER_US * 1000), window);
+
+	rte_free(in_flight);
+
 	// Discard 3-way handshake packets in the DPDK metrics
 	rte_eth_stats_reset(portid);
 	rte_eth_xstats_reset(portid);
@@ -248,25 +597,58 @@ void start_client(uint16_t portid)
 	rte_compiler_barrier();
 }
 
+// Discard the responses recorded so far when the main lcore asks (saturation search, between probes)
+static inline void check_rx_reset(rx_results_t *results)
+{
+	if (unlikely(__atomic_load_n(&results->reset, __ATOMIC_ACQUIRE)))
+	{
+		results->incoming_idx = 0;
+		results->retransmitted = 0;
+		results->lost = 0;
+		for (uint32_t p = 0; p < nr_phases; p++)
+		{
+			histogram_reset(results->histograms[p]);
+		}
+		for (uint32_t c = 0; c < SIZE_CLASSES; c++)
+		{
+			if (results->size_histograms[c])
+			{
+				histogram_reset(results->size_histograms[c]);
+			}
+		}
+		__atomic_store_n(&results->reset, 0, __ATOMIC_RELEASE);
+	}
+}
+
 // RX processing
 static int lcore_rx_ring(void *arg)
 {
 	uint16_t nb_rx;
 	struct rte_mbuf *pkts[BURST_SIZE];
+	lcore_counters_t *counters = &lcore_counters[rte_lcore_id()];
+	rx_results_t *results = &rx_results[0];
 
-	incoming_idx = 0;
+	results->incoming_idx = 0;
 
 	while (!quit_rx_ring)
 	{
+		// start recording again (saturation search, between probes)
+		check_rx_reset(results);
+
 		// retrieve packets from the RX core
 		nb_rx = rte_ring_sc_dequeue_burst(rx_ring, (void **)pkts, BURST_SIZE, NULL);
 		for (int i = 0; i < nb_rx; i++)
 		{
 			// process the incoming packet
-			process_rx_pkt(pkts[i], incoming_array, &incoming_idx);
+			process_rx_pkt(pkts[i], results, 0);
 			// free the packet
 			rte_pktmbuf_free(pkts[i]);
 		}
+
+		if (nb_rx > 0)
+		{
+			counter_add(&counters->rx_processed, nb_rx);
+		}
 	}
 
 	// process all remaining packets that are in the RX ring (not from the NIC)
@@ -276,12 +658,18 @@ static int lcore_rx_ring(void *arg)
 		for (int i = 0; i < nb_rx; i++)
 		{
 			// process the incoming packet
-			process_rx_pkt(pkts[i], incoming_array, &incoming_idx);
+			process_rx_pkt(pkts[i], results, 0);
 			// free the packet
 			rte_pktmbuf_free(pkts[i]);
 		}
 	} while (nb_rx != 0);
 
+	// let the writer lcore finish the binary output
+	if (bin_writer)
+	{
+		writer_flush(bin_writer, 0);
+	}
+
 	return 0;
 }
 
@@ -295,18 +683,30 @@ static int lcore_rx(void *arg)
 	uint16_t nb_rx;
 	uint16_t nb_pkts;
 	struct rte_mbuf *pkts[BURST_SIZE];
+	lcore_counters_t *counters = &lcore_counters[rte_lcore_id()];
 
 	while (!quit_rx)
 	{
 		// retrieve the packets from the NIC
 		nb_rx = rte_eth_rx_burst(portid, qid, pkts, BURST_SIZE);
+		if (nb_rx == 0)
+		{
+			continue;
+		}
+		counter_add(&counters->rx_pkts, nb_rx);
 
 		// retrive the current timestamp
 		now = rte_rdtsc();
 		for (int i = 0; i < nb_rx; i++)
 		{
-			// fill the timestamp into packet payload
-			fill_payload_pkt(pkts[i], 1, now);
+			// keep the timestamp in the mbuf
+			set_rx_tsc(pkts[i], now);
+		}
+
+		// tag the packets with their flow ids when the NIC does not
+		if (flow_classifier == CLASSIFIER_SOFTWARE)
+		{
+			classifier_lookup_bulk(flow_classifier_table, pkts, nb_rx);
 		}
 
 		// enqueue the packets to the ring
@@ -320,69 +720,744 @@ static int lcore_rx(void *arg)
 	return 0;
 }
 
+// Run-to-completion RX processing of one RX queue (timestamp, TCB update, and latency record without a ring)
+static int lcore_rx_queue(void *arg)
+{
+	uint16_t portid = 0;
+	uint16_t qid = (uint16_t)(uintptr_t)arg;
+
+	uint64_t now;
+	uint16_t nb_rx;
+	struct rte_mbuf *pkts[BURST_SIZE];
+	lcore_counters_t *counters = &lcore_counters[rte_lcore_id()];
+	rx_results_t *results = &rx_results[qid];
+
+	results->incoming_idx = 0;
+
+	while (!quit_rx)
+	{
+		// start recording again (saturation search, between probes)
+		check_rx_reset(results);
+
+		// retrieve the packets from the NIC
+		nb_rx = rte_eth_rx_burst(portid, qid, pkts, BURST_SIZE);
+		if (nb_rx == 0)
+		{
+			continue;
+		}
+
+		// retrive the current timestamp
+		now = rte_rdtsc();
+
+		// tag the packets with their flow ids when the NIC does not
+		if (flow_classifier == CLASSIFIER_SOFTWARE)
+		{
+			classifier_lookup_bulk(flow_classifier_table, pkts, nb_rx);
+		}
+
+		for (int i = 0; i < nb_rx; i++)
+		{
+			// keep the timestamp in the mbuf and process the packet right away
+			set_rx_tsc(pkts[i], now);
+			process_rx_pkt(pkts[i], results, qid);
+		}
+		rte_pktmbuf_free_bulk(pkts, nb_rx);
+
+		counter_add(&counters->rx_pkts, nb_rx);
+		counter_add(&counters->rx_processed, nb_rx);
+	}
+
+	// let the writer lcore finish the binary output
+	if (bin_writer)
+	{
+		writer_flush(bin_writer, qid);
+	}
+
+	return 0;
+}
+
+// Create the retransmission timers of the flows of the TX lcore (NULL when retransmissions are disabled)
+static timer_wheel_t *create_rto_wheel()
+{
+	if (rto_us == 0)
+	{
+		return NULL;
+	}
+
+	uint32_t nr_owned = (nr_flows + nr_tx_lcores - 1) / nr_tx_lcores;
+	timer_wheel_t *wheel = timer_wheel_create(nr_owned, TIMER_WHEEL_TICK_US * TICKS_PER_US, rte_rdtsc());
+	if (wheel == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the retransmission timers.\n");
+	}
+
+	return wheel;
+}
+
+// Disarm the timers left and free the wheel (the next run starts with no timer armed)
+static void free_rto_wheel(timer_wheel_t *wheel, uint16_t qid)
+{
+	if (wheel == NULL)
+	{
+		return;
+	}
+
+	for (uint32_t flow_id = qid; flow_id < nr_flows; flow_id += nr_tx_lcores)
+	{
+		tcp_control_blocks[flow_id].rto_tsc = 0;
+	}
+	timer_wheel_free(wheel);
+}
+
+// Start the retransmission timer of the flows of the burst that have none (the flow f is the timer f / nr_tx_lcores)
+static inline void arm_rto(timer_wheel_t *wheel, tx_burst_t *burst, uint64_t now)
+{
+	uint64_t rto_ticks = rto_us * TICKS_PER_US;
+
+	for (uint16_t j = 0; j < burst->nb_pkts; j++)
+	{
+		tcp_control_block_t *block = burst->blocks[j];
+		if (block->rto_tsc == 0)
+		{
+			block->rto_tsc = now;
+			block->rto_seq = __atomic_load_n(&block->last_ack_recv, __ATOMIC_RELAXED);
+			timer_wheel_add(wheel, (block - tcp_control_blocks) / nr_tx_lcores, now + rto_ticks);
+		}
+	}
+}
+
+// Send the oldest unacked request again for the flows whose timer expired without any progress
+static void process_rto(uint16_t portid, uint16_t qid, timer_wheel_t *wheel, lcore_counters_t *counters)
+{
+	uint32_t n;
+	uint32_t ids[BURST_SIZE];
+	struct rte_mbuf *pkts[BURST_SIZE];
+	uint64_t now = rte_rdtsc();
+	uint64_t rto_ticks = rto_us * TICKS_PER_US;
+
+	do
+	{
+		uint16_t nb_pkts = 0;
+		n = timer_wheel_expire(wheel, now, ids, BURST_SIZE);
+		for (uint32_t j = 0; j < n; j++)
+		{
+			uint32_t flow_id = ids[j] * nr_tx_lcores + qid;
+			tcp_control_block_t *block = &tcp_control_blocks[flow_id];
+			uint32_t una = __atomic_load_n(&block->last_ack_recv, __ATOMIC_RELAXED);
+
+			// all requests were acked, so the timer waits for the next request
+			if (una == block->tcb_next_seq)
+			{
+				block->rto_tsc = 0;
+				continue;
+			}
+
+			// the ACKs moved forward, so the oldest unacked request gets a whole RTO
+			if (una != block->rto_seq)
+			{
+				block->rto_seq = una;
+				block->rto_tsc = now;
+				timer_wheel_add(wheel, ids[j], now + rto_ticks);
+				continue;
+			}
+
+			// the retransmission carries its own send time and is flagged in the flow id
+			struct rte_mbuf *pkt = rte_pktmbuf_alloc(pktmbuf_pool_tx);
+
+			// the pool is exhausted (retransmissions fire under pressure), so try again after another RTO
+			if (unlikely(pkt == NULL))
+			{
+				timer_wheel_add(wheel, ids[j], now + rto_ticks);
+				continue;
+			}
+
+			fill_tcp_retransmission(block, pkt, una);
+			wire_header_t header = {
+					.t0 = now,
+					.tag = request_tag(flow_id, tcp_payload_size, retransmission_response_size()) | RETRANSMISSION_FLAG,
+			};
+			fill_payload_pkt(pkt, &header);
+			pkts[nb_pkts++] = pkt;
+
+			block->rto_tsc = now;
+			timer_wheel_add(wheel, ids[j], now + rto_ticks);
+		}
+
+		send_pkts(portid, qid, pkts, nb_pkts);
+		counter_add(&counters->retransmitted, nb_pkts);
+	} while (n == BURST_SIZE);
+}
+
+// Keep retransmitting after the last request until every flow is acked (bounded by a few RTOs)
+static void drain_rto(uint16_t portid, uint16_t qid, timer_wheel_t *wheel, lcore_counters_t *counters)
+{
+	uint64_t end_tsc = rte_rdtsc() + RTO_DRAIN_RTOS * rto_us * TICKS_PER_US;
+
+	while (wheel->nr_timers > 0 && rte_rdtsc() < end_tsc && !quit_tx)
+	{
+		process_rto(portid, qid, wheel, counters);
+	}
+}
+
+// Send all packets of the burst once the earliest deadline is reached
+static inline void flush_tx_burst(uint16_t portid, uint16_t qid, tx_burst_t *burst, tx_batch_stats_t *stats, lcore_counters_t *counters, timer_wheel_t *wheel)
+{
+	uint64_t first_tsc = burst->deadlines[0];
+
+	// retransmit while waiting for the deadline
+	if (wheel)
+	{
+		process_rto(portid, qid, wheel, counters);
+	}
+
+	// sleep for while
+	while (rte_rdtsc() < first_tsc)
+	{
+	}
+
+	for (uint16_t j = 0; j < burst->nb_pkts; j++)
+	{
+		// fill the TCP ACK field
+		hot_fill_tcp_packet(burst->blocks[j], burst->pkts[j]);
+
+		// packets after the first one leave earlier than their deadlines
+		uint64_t early = burst->deadlines[j] - first_tsc;
+		stats->early_ticks_sum += early;
+		if (early > stats->early_ticks_max)
+		{
+			stats->early_ticks_max = early;
+		}
+	}
+
+	// send the packets
+	send_pkts(portid, qid, burst->pkts, burst->nb_pkts);
+
+	// the requests just sent are covered by the timer of their flows
+	if (wheel)
+	{
+		arm_rto(wheel, burst, rte_rdtsc());
+	}
+
+	stats->nr_bursts++;
+	stats->nr_pkts += burst->nb_pkts;
+	counter_add(&counters->tx_pkts, burst->nb_pkts);
+	burst->nb_pkts = 0;
+}
+
+// Check whether the receive window of the flow has no room for a request of request_size bytes
+static inline int window_closed(tcp_control_block_t *block, uint32_t request_size)
+{
+	uint32_t rx_wnd = rte_atomic32_read(&block->tcb_rwin);
+
+	return rx_wnd < request_size;
+}
+
+// Build the next request of the flow with its send time, flow id, sizes, server iterations, and server randomness
+static inline struct rte_mbuf *build_request(tcp_control_block_t *block, uint32_t flow_id, uint64_t t0, const application_node_t *app)
+{
+	// allocated the packet
+	struct rte_mbuf *pkt = rte_pktmbuf_alloc(pktmbuf_pool_tx);
+
+	// fill the packet fields
+	fill_tcp_packet(block, pkt, app->request_size);
+
+	// fill the timestamp, flow id and sizes, server iterations, and server randomness into the packet payload
+	wire_header_t header = {
+			.t0 = t0,
+			.tag = request_tag(flow_id, app->request_size, app->response_size),
+			.iterations = app->iterations,
+			.randomness = app->randomness,
+	};
+	fill_payload_pkt(pkt, &header);
+
+	return pkt;
+}
+
+// Check whether the burst holds requests of flows with parked requests
+static inline int burst_has_deferred(const tx_burst_t *burst, const deferred_queue_t *dq)
+{
+	for (uint16_t j = 0; j < burst->nb_pkts; j++)
+	{
+		if (deferred_has(dq, (burst->blocks[j] - tcp_control_blocks) / nr_tx_lcores))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Park the request until the window of its flow reopens (-1 if the deferred queue is full)
+static inline int defer_request(deferred_queue_t *dq, uint32_t flow_id, uint64_t deadline, const application_node_t *app)
+{
+	deferred_request_t req = {
+			.deadline = deadline,
+			.iterations = app->iterations,
+			.randomness = app->randomness,
+			.flow_id = flow_id,
+			.request_size = app->request_size,
+			.response_size = app->response_size,
+	};
+
+	return deferred_park(dq, flow_id / nr_tx_lcores, &req);
+}
+
+// Send the parked requests of the flows whose window reopened (oldest first within a flow, one burst at most)
+static void release_deferred(uint16_t portid, uint16_t qid, deferred_queue_t *dq, tx_batch_stats_t *stats, lcore_counters_t *counters, timer_wheel_t *wheel)
+{
+	tx_burst_t burst = {.nb_pkts = 0};
+	uint64_t now = rte_rdtsc();
+	double ticks_per_ns = (double)TICKS_PER_US / 1000;
+
+	for (uint32_t k = 0; k < dq->nb_blocked && burst.nb_pkts < BURST_SIZE;)
+	{
+		uint32_t flow = dq->blocked[k];
+		tcp_control_block_t *block = &tcp_control_blocks[flow * nr_tx_lcores + qid];
+
+		while (deferred_has(dq, flow) && !window_closed(block, deferred_peek(dq, flow)->request_size) && burst.nb_pkts < BURST_SIZE)
+		{
+			// the request leaves now, so its latency is the network latency and the wait is recorded apart
+			deferred_request_t *req = deferred_peek(dq, flow);
+			histogram_record(dq->waited, (uint64_t)((now - req->deadline) / ticks_per_ns));
+
+			burst.deadlines[burst.nb_pkts] = now;
+			burst.blocks[burst.nb_pkts] = block;
+			application_node_t app = {
+					.iterations = req->iterations,
+					.randomness = req->randomness,
+					.request_size = req->request_size,
+					.response_size = req->response_size,
+			};
+			burst.pkts[burst.nb_pkts] = build_request(block, req->flow_id, now, &app);
+			burst.nb_pkts++;
+			deferred_pop(dq, flow);
+		}
+
+		// the flow has no more parked requests
+		if (!deferred_has(dq, flow))
+		{
+			dq->blocked[k] = dq->blocked[--dq->nb_blocked];
+			continue;
+		}
+		k++;
+	}
+
+	if (burst.nb_pkts > 0)
+	{
+		flush_tx_burst(portid, qid, &burst, stats, counters, wheel);
+	}
+}
+
+// Keep releasing the parked requests after the schedule (bounded), returning how many were dropped
+static uint64_t drain_deferred(uint16_t portid, uint16_t qid, deferred_queue_t *dq, tx_batch_stats_t *stats, lcore_counters_t *counters, timer_wheel_t *wheel)
+{
+	uint64_t end_tsc = rte_rdtsc() + DEFERRED_DRAIN_IN_US * TICKS_PER_US;
+
+	while (dq->nb_blocked > 0 && rte_rdtsc() < end_tsc && !quit_tx)
+	{
+		release_deferred(portid, qid, dq, stats, counters, wheel);
+	}
+
+	return deferred_reset(dq);
+}
+
+// Schedule producer for the streaming mode
+static int lcore_schedule(void *arg)
+{
+	for (uint64_t i = 0; i < nr_elements && !quit_tx; i += SCHEDULE_CHUNK_ELEMENTS)
+	{
+		produce_schedule_chunk(i, RTE_MIN((uint64_t)SCHEDULE_CHUNK_ELEMENTS, nr_elements - i));
+	}
+
+	// notify the TX lcores that there are no more chunks
+	__atomic_store_n(&schedule_done, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
 // Main TX processing
 static int lcore_tx(void *arg)
 {
 	uint16_t portid = 0;
-	uint8_t qid = 0;
-	uint64_t nr_elements = rate * duration;
+	uint16_t qid = (uint16_t)(uintptr_t)arg;
 
 	struct rte_mbuf *pkt;
+	uint32_t never_sent = 0;
+	tx_burst_t burst = {.nb_pkts = 0};
+	tx_batch_stats_t *stats = &tx_batch_stats[qid];
+	lcore_counters_t *counters = &lcore_counters[rte_lcore_id()];
+	uint64_t window_ticks = (tx_batch_window * TICKS_PER_US) / 1000;
+	deferred_queue_t *dq = deferred_queues[qid];
+	uint64_t poll_ticks = DEFERRED_POLL_IN_US * TICKS_PER_US;
+	uint64_t next_poll_tsc = 0;
+
+	schedule_chunk_t *chunk = next_schedule_chunk(qid, NULL);
+	if (chunk == NULL)
+	{
+		return 0;
+	}
+	timer_wheel_t *wheel = create_rto_wheel();
 
-	uint64_t next_tsc = rte_rdtsc() + interarrival_array[0];
+	// all TX lcores share the same time origin, so the aggregate schedule is preserved (slip delays the requests left after
+	// falling behind)
+	uint64_t slip = 0;
 
-	for (uint64_t i = 0; i < nr_elements; i++)
+	// the schedule holds only the requests of the flows of this TX lcore
+	for (; chunk != NULL && !quit_tx; chunk = next_schedule_chunk(qid, chunk))
 	{
-		// unable to keep up with the requested rate
-		if (unlikely(rte_rdtsc() > (next_tsc + 5 * TICKS_PER_US)))
+		for (uint64_t i = 0; i < chunk->nr_elements && !quit_tx; i++)
 		{
-			// count this batch as dropped
-			nr_never_sent++;
-			next_tsc += (interarrival_array[i] + TICKS_PER_US);
-			continue;
+			uint64_t next_tsc = tx_start_tsc + slip + chunk->deadline[i];
+
+			// choose the flow to send
+			uint32_t flow_id = chunk->flow_indexes[i];
+
+			// unable to keep up with the requested rate
+			if (unlikely(rte_rdtsc() > (next_tsc + 5 * TICKS_PER_US)))
+			{
+				// count this batch as dropped
+				never_sent++;
+				counter_add(&counters->never_sent, 1);
+				slip += TICKS_PER_US;
+				continue;
+			}
+
+			// send the parked requests of the flows whose window reopened (the older requests of those flows still in the
+			// pending burst leave first, so the parked ones never overtake them)
+			if (unlikely(dq->nb_blocked > 0) && rte_rdtsc() >= next_poll_tsc)
+			{
+				if (burst_has_deferred(&burst, dq))
+				{
+					flush_tx_burst(portid, qid, &burst, stats, counters, wheel);
+				}
+				release_deferred(portid, qid, dq, stats, counters, wheel);
+				next_poll_tsc = rte_rdtsc() + poll_ticks;
+			}
+
+			tcp_control_block_t *block = &tcp_control_blocks[flow_id];
+
+			// the window of the flow is closed (or older requests of the flow are parked), so park the request instead of
+			// blocking the schedule of the other flows
+			if (unlikely(deferred_has(dq, flow_id / nr_tx_lcores) || window_closed(block, chunk->application[i].request_size)))
+			{
+				if (defer_request(dq, flow_id, next_tsc, &chunk->application[i]) != 0)
+				{
+					never_sent++;
+					counter_add(&counters->never_sent, 1);
+				}
+				continue;
+			}
+
+			// the deadline is outside of the current window, so send the pending burst
+			if (burst.nb_pkts > 0 && ((next_tsc - burst.deadlines[0]) > window_ticks || burst.nb_pkts == BURST_SIZE))
+			{
+				flush_tx_burst(portid, qid, &burst, stats, counters, wheel);
+			}
+
+			// build the packet
+			pkt = build_request(block, flow_id, next_tsc, &chunk->application[i]);
+
+			// add the packet to the burst
+			burst.deadlines[burst.nb_pkts] = next_tsc;
+			burst.blocks[burst.nb_pkts] = block;
+			burst.pkts[burst.nb_pkts] = pkt;
+			burst.nb_pkts++;
 		}
+	}
 
-		// choose the flow to send
-		uint16_t flow_id = flow_indexes_array[i];
-		tcp_control_block_t *block = &tcp_control_blocks[flow_id];
+	// send the remaining packets
+	if (burst.nb_pkts > 0)
+	{
+		flush_tx_burst(portid, qid, &burst, stats, counters, wheel);
+	}
 
-		// allocated the packet
-		pkt = rte_pktmbuf_alloc(pktmbuf_pool_tx);
+	// the requests still parked are sent if their windows reopen in time (the others are never sent)
+	uint64_t dropped = drain_deferred(portid, qid, dq, stats, counters, wheel);
+	never_sent += dropped;
+	counter_add(&counters->never_sent, dropped);
 
-		// fill the packet fields
-		fill_tcp_packet(block, pkt);
+	// the last requests are retransmitted too
+	if (wheel)
+	{
+		drain_rto(portid, qid, wheel, counters);
+		free_rto_wheel(wheel, qid);
+	}
 
-		// fill the timestamp, flow id, server iterations, and server randomness into the packet payload
-		fill_payload_pkt(pkt, 0, next_tsc);
-		fill_payload_pkt(pkt, 2, (uint64_t)flow_id);
-		fill_payload_pkt(pkt, 4, application_array[i].iterations);
-		fill_payload_pkt(pkt, 5, application_array[i].randomness);
+	// update the global counter
+	__atomic_fetch_add(&nr_never_sent, never_sent, __ATOMIC_RELAXED);
+
+	return 0;
+}
 
-		// check the receive window for this flow
-		uint16_t rx_wnd = rte_atomic16_read(&block->tcb_rwin);
-		while (unlikely(rx_wnd < tcp_payload_size))
+// Insert the request in the min-heap of pending requests
+static inline void pending_push(pending_request_t *heap, uint32_t *size, uint64_t deadline, uint32_t flow_id)
+{
+	uint32_t i = (*size)++;
+	while (i > 0 && heap[(i - 1) / 2].deadline > deadline)
+	{
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i].deadline = deadline;
+	heap[i].flow_id = flow_id;
+}
+
+// Remove the earliest request from the min-heap of pending requests
+static inline void pending_pop(pending_request_t *heap, uint32_t *size)
+{
+	pending_request_t last = heap[--(*size)];
+	uint32_t i = 0;
+	while (2 * i + 1 < *size)
+	{
+		uint32_t child = 2 * i + 1;
+		if (child + 1 < *size && heap[child + 1].deadline < heap[child].deadline)
+		{
+			child++;
+		}
+		if (last.deadline <= heap[child].deadline)
 		{
-			rx_wnd = rte_atomic16_read(&block->tcb_rwin);
+			break;
 		}
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+}
+
+// Build the next request of the flow and add it to the burst or park it while the window of the flow is closed
+// (-1 if the deferred queue is full)
+static inline int queue_closed_loop_request(tx_burst_t *burst, deferred_queue_t *dq, uint32_t flow_id, uint64_t deadline, uint64_t idx)
+{
+	application_node_t app;
+	tcp_control_block_t *block = &tcp_control_blocks[flow_id];
 
-		// sleep for while
-		while (rte_rdtsc() < next_tsc)
+	sample_application(&app, idx);
+
+	if (unlikely(deferred_has(dq, flow_id / nr_tx_lcores) || window_closed(block, app.request_size)))
+	{
+		return defer_request(dq, flow_id, deadline, &app);
+	}
+
+	// add the packet to the burst, stamped when it is built (the time waited behind the other pending requests is not
+	// latency)
+	burst->deadlines[burst->nb_pkts] = deadline;
+	burst->blocks[burst->nb_pkts] = block;
+	burst->pkts[burst->nb_pkts] = build_request(block, flow_id, rte_rdtsc(), &app);
+	burst->nb_pkts++;
+
+	return 0;
+}
+
+// Closed-loop TX processing: each flow keeps at most closed_loop_window requests in flight
+static int lcore_tx_closed_loop(void *arg)
+{
+	uint16_t portid = 0;
+	uint16_t qid = (uint16_t)(uintptr_t)arg;
+
+	uint64_t idx = 0;
+	uint64_t think_idx = 0;
+	uint32_t nb_pending = 0;
+	uint32_t completions[BURST_SIZE];
+	tx_burst_t burst = {.nb_pkts = 0};
+	tx_batch_stats_t *stats = &tx_batch_stats[qid];
+	lcore_counters_t *counters = &lcore_counters[rte_lcore_id()];
+	uint64_t think_ticks = think_time * TICKS_PER_US;
+	uint64_t retry_ticks = DEFERRED_POLL_IN_US * TICKS_PER_US;
+	uint64_t end_tsc = tx_start_tsc + duration * 1000000 * TICKS_PER_US;
+
+	timer_wheel_t *wheel = create_rto_wheel();
+	deferred_queue_t *dq = deferred_queues[qid];
+
+	// at most one pending request per outstanding slot of the flows owned by this lcore
+	uint32_t nr_slots = ((nr_flows + nr_tx_lcores - 1) / nr_tx_lcores) * closed_loop_window;
+	pending_request_t *pending = (pending_request_t *)rte_malloc(NULL, nr_slots * sizeof(pending_request_t), 64);
+	if (pending == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the pending requests.\n");
+	}
+
+	// fill the window of all flows owned by this lcore at the start
+	for (uint32_t flow_id = qid; flow_id < nr_flows; flow_id += nr_tx_lcores)
+	{
+		for (uint32_t k = 0; k < closed_loop_window; k++)
 		{
+			pending_push(pending, &nb_pending, tx_start_tsc, flow_id);
 		}
+	}
 
-		// fill the TCP ACK field
-		hot_fill_tcp_packet(block, pkt);
+	while (rte_rdtsc() < end_tsc && !quit_tx)
+	{
+		uint64_t now = rte_rdtsc();
 
-		// send the packet
-		rte_eth_tx_burst(portid, qid, &pkt, 1);
+		// the next request of each completed flow is issued after the think time (completions without a free slot stay in
+		// the ring, so no flow loses part of its window)
+		uint32_t nb_free = RTE_MIN((uint32_t)BURST_SIZE, nr_slots - nb_pending);
+		uint32_t nb_done = rte_ring_sc_dequeue_burst_elem(completion_rings[qid], completions, sizeof(uint32_t), nb_free, NULL);
+		for (uint32_t j = 0; j < nb_done; j++)
+		{
+			uint64_t think = 0;
+			if (think_ticks > 0)
+			{
+				rng_block_t r = rng_philox(seed, RNG_STREAM_THINK, (think_idx++) * nr_tx_lcores + qid);
+				think = sample_exponential(1.0 / think_ticks, rng_u01(r.x0));
+			}
+			pending_push(pending, &nb_pending, now + think, completions[j]);
+		}
+
+		// send all requests whose think time expired
+		while (nb_pending > 0 && pending[0].deadline <= now && burst.nb_pkts < BURST_SIZE)
+		{
+			pending_request_t req = pending[0];
+			pending_pop(pending, &nb_pending);
+
+			// with the deferred queue full, the request goes back to the pending ones (the flow keeps its slot)
+			if (unlikely(queue_closed_loop_request(&burst, dq, req.flow_id, req.deadline, (idx++) * nr_tx_lcores + qid) != 0))
+			{
+				pending_push(pending, &nb_pending, now + retry_ticks, req.flow_id);
+			}
+		}
+
+		if (burst.nb_pkts > 0)
+		{
+			flush_tx_burst(portid, qid, &burst, stats, counters, wheel);
+		}
+		else if (wheel)
+		{
+			// a lost request leaves its flow waiting, so the timers run even when nothing is sent
+			process_rto(portid, qid, wheel, counters);
+		}
 
-		// update the counter
-		next_tsc += interarrival_array[i];
+		// send the parked requests of the flows whose window reopened
+		if (unlikely(dq->nb_blocked > 0))
+		{
+			release_deferred(portid, qid, dq, stats, counters, wheel);
+		}
+	}
+
+	// the requests still parked at the end are never sent
+	counter_add(&counters->never_sent, deferred_reset(dq));
+
+	// the last requests are retransmitted too
+	if (wheel)
+	{
+		drain_rto(portid, qid, wheel, counters);
+		free_rto_wheel(wheel, qid);
 	}
 
+	rte_free(pending);
+
 	return 0;
 }
 
+// Start the schedule producer (streaming mode) and the TX lcores after id_lcore, returning the lcores used
+static uint32_t launch_tx_lcores(uint32_t id_lcore, uint32_t *lcores)
+{
+	uint32_t nb_lcores = 0;
+
+	// start the schedule producer and wait until it fills all chunks (or finishes)
+	if (stream_schedule)
+	{
+		__atomic_store_n(&schedule_done, 0, __ATOMIC_RELEASE);
+		id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		lcores[nb_lcores++] = id_lcore;
+		rte_eal_remote_launch(lcore_schedule, NULL, id_lcore);
+		while (rte_mempool_avail_count(schedule_pool) > 0 && !__atomic_load_n(&schedule_done, __ATOMIC_ACQUIRE))
+		{
+			rte_pause();
+		}
+	}
+
+	// start TX threads (one TX queue per lcore)
+	tx_start_tsc = rte_rdtsc() + TX_START_DELAY_IN_US * TICKS_PER_US;
+	set_phases_start(tx_start_tsc);
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		lcores[nb_lcores++] = id_lcore;
+		rte_eal_remote_launch(closed_loop_window > 0 ? lcore_tx_closed_loop : lcore_tx, (void *)(uintptr_t)q, id_lcore);
+	}
+
+	return nb_lcores;
+}
+
+// Binary-search the highest rate that meets the latency SLO, keeping the connections open between probes
+static void run_saturation_search(uint32_t id_lcore)
+{
+	uint32_t lcores[RTE_MAX_LCORE];
+	probe_result_t results[MAX_PROBES];
+	uint32_t nr_probes = 0;
+
+	double max_rate = rate;
+	double lo = 0;
+	double hi = max_rate;
+	double probe_rate = max_rate;
+
+	while (nr_probes < MAX_PROBES)
+	{
+		set_probe_phase(probe_rate);
+		nr_never_sent = 0;
+
+		// discard the parked requests and the waits of the previous probe
+		for (uint32_t q = 0; q < nr_tx_lcores; q++)
+		{
+			deferred_reset(deferred_queues[q]);
+			histogram_reset(deferred_queues[q]->waited);
+		}
+
+		// discard the responses of the previous probe
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			__atomic_store_n(&rx_results[q].reset, 1, __ATOMIC_RELEASE);
+		}
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			while (__atomic_load_n(&rx_results[q].reset, __ATOMIC_ACQUIRE))
+			{
+				rte_pause();
+			}
+		}
+
+		create_schedule();
+
+		// run the probe and wait for the last responses
+		uint32_t nb_lcores = launch_tx_lcores(id_lcore, lcores);
+		for (uint32_t j = 0; j < nb_lcores; j++)
+		{
+			rte_eal_wait_lcore(lcores[j]);
+		}
+		rte_delay_us_sleep(SEARCH_DRAIN_IN_US);
+
+		probe_result_t *result = &results[nr_probes++];
+		evaluate_probe(result, probe_rate);
+		free_schedule_arrays();
+
+		// the writer lcore could not write the binary output, so the search stops
+		if (bin_writer && writer_failed(bin_writer))
+		{
+			fprintf(stderr, "stopping the saturation search early\n");
+			break;
+		}
+
+		if (result->pass)
+		{
+			lo = probe_rate;
+		}
+		else
+		{
+			hi = probe_rate;
+		}
+
+		// stop when the maximum rate meets the SLO or the interval is small enough
+		if ((result->pass && probe_rate == max_rate) || (hi - lo) <= SEARCH_PRECISION * max_rate)
+		{
+			break;
+		}
+		probe_rate = (lo + hi) / 2;
+	}
+
+	print_search_output(results, nr_probes, lo);
+}
+
 // main function
 int main(int argc, char **argv)
 {
@@ -407,17 +1482,21 @@ int main(int argc, char **argv)
 	uint16_t portid = 0;
 	init_DPDK(portid, seed);
 
-	// create nodes for incoming packets
+	// create nodes for incoming packets (only with an output file)
 	create_incoming_array();
 
-	// create flow indexes array
-	create_flow_indexes_array();
+	// create the latency histograms of the phases
+	create_latency_histograms();
+	create_deferred_queues();
 
-	// create interarrival array
-	create_interarrival_array();
+	// open the binary output (only with -b)
+	create_binary_output();
 
-	// create application array
-	create_application_array();
+	// create the arrival schedule (done for each probe in the saturation search)
+	if (slo_percentile == 0)
+	{
+		create_schedule();
+	}
 
 	// initialize TCP control blocks
 	init_tcp_blocks();
@@ -425,39 +1504,83 @@ int main(int argc, char **argv)
 	// Calibrate TSC
 	calibrate_tsc();
 
+	// expose the live counters through DPDK telemetry
+	register_telemetry();
+
 	// start client (3-way handshake for each flow)
 	start_client(portid);
 
-	// create the DPDK ring for RX thread
-	create_dpdk_ring();
+	// create the DPDK ring for RX thread (not used by the run-to-completion RX lcores)
+	if (!rx_inline)
+	{
+		create_dpdk_ring();
+	}
 
-	// start RX thread to process incoming packets
 	uint32_t id_lcore = rte_lcore_id();
-	id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
-	rte_eal_remote_launch(lcore_rx_ring, NULL, id_lcore);
-
-	// start RX thread to receive incoming packets
-	id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
-	rte_eal_remote_launch(lcore_rx, NULL, id_lcore);
-
-	// start TX thread
-	id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
-	rte_eal_remote_launch(lcore_tx, NULL, id_lcore);
-
-	// wait for duration parameter
-	wait_timeout();
-
-	// wait for RX/TX threads
-	// uint32_t lcore_id;
-	// RTE_LCORE_FOREACH_WORKER(lcore_id) {
-	//	if(rte_eal_wait_lcore(lcore_id) < 0) {
-	//		return -1;
-	//	}
-	//}
-	sleep(5);
-
-	// print stats
-	print_stats_output();
+	if (rx_inline)
+	{
+		// start one RX thread per RX queue to receive and process incoming packets
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+			rte_eal_remote_launch(lcore_rx_queue, (void *)(uintptr_t)q, id_lcore);
+		}
+	}
+	else
+	{
+		// start RX thread to process incoming packets
+		id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		rte_eal_remote_launch(lcore_rx_ring, NULL, id_lcore);
+
+		// start RX thread to receive incoming packets
+		id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		rte_eal_remote_launch(lcore_rx, NULL, id_lcore);
+	}
+
+	// start the writer thread to stream the binary output to disk
+	uint32_t writer_lcore = 0;
+	if (bin_writer)
+	{
+		writer_lcore = id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		rte_eal_remote_launch(lcore_writer, bin_writer, id_lcore);
+	}
+
+	if (slo_percentile > 0)
+	{
+		// search the saturation point and stop the RX threads
+		run_saturation_search(id_lcore);
+		quit_rx = 1;
+		quit_rx_ring = 1;
+		rte_eal_mp_wait_lcore();
+	}
+	else
+	{
+		// start TX threads
+		uint32_t lcores[RTE_MAX_LCORE];
+		launch_tx_lcores(id_lcore, lcores);
+
+		// wait for duration parameter
+		wait_timeout();
+
+		// wait for RX/TX threads
+		// uint32_t lcore_id;
+		// RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		//	if(rte_eal_wait_lcore(lcore_id) < 0) {
+		//		return -1;
+		//	}
+		//}
+		sleep(5);
+
+		// print stats
+		print_stats_output();
+
+		// finish the binary output once the RX thread flushed its last block
+		if (bin_writer)
+		{
+			rte_eal_wait_lcore(writer_lcore);
+			close_binary_output();
+		}
+	}
 
 	// print DPDK stats
 	print_dpdk_stats(portid);
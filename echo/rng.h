@@ -0,0 +1,81 @@
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include <stdint.h>
+
+// Independent random streams (one per kind of value in the schedule)
+#define RNG_STREAM_INTERARRIVAL 0
+#define RNG_STREAM_APPLICATION 1
+#define RNG_STREAM_THINK 2
+#define RNG_STREAM_FLOW 3
+#define RNG_STREAM_REQUEST_SIZE 4
+#define RNG_STREAM_RESPONSE_SIZE 5
+
+#define PHILOX_M0 0xD2511F53
+#define PHILOX_M1 0xCD9E8D57
+#define PHILOX_W0 0x9E3779B9
+#define PHILOX_W1 0xBB67AE85
+#define PHILOX_ROUNDS 10
+
+// Output of one Philox4x32 evaluation (128 random bits)
+typedef struct rng_block_t
+{
+	uint64_t x0;
+	uint64_t x1;
+} rng_block_t;
+
+// Philox4x32-10 counter-based generator: the output depends only on (seed, stream, counter),
+// so any element of the schedule can be generated independently of all the others
+static inline rng_block_t rng_philox(uint32_t seed, uint32_t stream, uint64_t counter)
+{
+	uint32_t c0 = (uint32_t)counter;
+	uint32_t c1 = (uint32_t)(counter >> 32);
+	uint32_t c2 = 0;
+	uint32_t c3 = 0;
+	uint32_t k0 = seed;
+	uint32_t k1 = stream;
+
+	for (int r = 0; r < PHILOX_ROUNDS; r++)
+	{
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+
+		c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)p1;
+		c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)p0;
+
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	rng_block_t block = {
+			.x0 = ((uint64_t)c1 << 32) | c0,
+			.x1 = ((uint64_t)c3 << 32) | c2,
+	};
+
+	return block;
+}
+
+// Mix 64 bits into 64 well-spread bits (SplitMix64 finalizer), for cheap per-key values
+static inline uint64_t rng_mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+
+	return x ^ (x >> 31);
+}
+
+// Map 32 random bits to [0, n) without a division
+static inline uint32_t rng_bounded(uint32_t x, uint32_t n)
+{
+	return (uint32_t)(((uint64_t)x * n) >> 32);
+}
+
+// Convert 64 random bits into a uniform double in the open interval (0,1)
+static inline double rng_u01(uint64_t x)
+{
+	return ((x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+#endif // __RNG_H__
@@ -1,54 +1,81 @@
 #include "tcp_util.h"
 
+// Pre-render the Ethernet, IPv4 and TCP headers of the data packets for the flow
+static void build_tcp_hdr_template(tcp_control_block_t *block)
+{
+	memset(block->tcb_hdr_template, 0, TCP_HDR_TEMPLATE_SIZE);
+
+	// fill Ethernet information
+	struct rte_ether_hdr *eth_hdr = (struct rte_ether_hdr *)block->tcb_hdr_template;
+	eth_hdr->dst_addr = dst_eth_addr;
+	eth_hdr->src_addr = src_eth_addr;
+	eth_hdr->ether_type = ETH_IPV4_TYPE_NETWORK;
+
+	// fill IPv4 information
+	struct rte_ipv4_hdr *ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+	ipv4_hdr->version_ihl = 0x45;
+	ipv4_hdr->total_length = rte_cpu_to_be_16(frame_size - sizeof(struct rte_ether_hdr));
+	ipv4_hdr->time_to_live = 255;
+	ipv4_hdr->packet_id = 0;
+	ipv4_hdr->next_proto_id = IPPROTO_TCP;
+	ipv4_hdr->fragment_offset = 0;
+	ipv4_hdr->src_addr = block->src_addr;
+	ipv4_hdr->dst_addr = block->dst_addr;
+	ipv4_hdr->hdr_checksum = 0;
+
+	// fill TCP information (SEQ and ACK numbers are patched for each packet)
+	struct rte_tcp_hdr *tcp_hdr = (struct rte_tcp_hdr *)(ipv4_hdr + 1);
+	tcp_hdr->dst_port = block->dst_port;
+	tcp_hdr->src_port = block->src_port;
+	tcp_hdr->sent_seq = 0;
+	tcp_hdr->recv_ack = 0;
+	tcp_hdr->data_off = (sizeof(struct rte_tcp_hdr) >> 2) << 4;
+	tcp_hdr->tcp_flags = RTE_TCP_PSH_FLAG | RTE_TCP_ACK_FLAG;
+	tcp_hdr->rx_win = 0xFFFF;
+	tcp_hdr->cksum = 0;
+	tcp_hdr->tcp_urp = 0;
+}
+
 // Create and initialize the TCP Control Blocks for all flows
 void init_tcp_blocks()
 {
-	// allocate the all control block structure previosly
-	tcp_control_blocks = (tcp_control_block_t *)rte_zmalloc("tcp_control_blocks", nr_flows * sizeof(tcp_control_block_t), RTE_CACHE_LINE_SIZE);
+	// each source address provides one flow per source port of the range
+	uint32_t nr_src_ports = (uint32_t)src_tcp_port_max - src_tcp_port_min + 1;
+	if (nr_flows > (uint64_t)nr_src_ports * src_ipv4_count)
+	{
+		rte_exit(EXIT_FAILURE, "%lu flows do not fit in %u source addresses x %u source ports.\n", nr_flows, src_ipv4_count, nr_src_ports);
+	}
 
-	// choose TCP source port for all flows
-	uint16_t src_tcp_port;
-	uint16_t src_ports[nr_flows];
-	for (uint32_t i = 0; i < nr_flows; i++)
+	// allocate the all control block structure previosly (in the hugepages of the port)
+	tcp_control_blocks = (tcp_control_block_t *)rte_zmalloc_socket("tcp_control_blocks", nr_flows * sizeof(tcp_control_block_t), RTE_CACHE_LINE_SIZE, rte_eth_dev_socket_id(portid));
+	if (tcp_control_blocks == NULL)
 	{
-		src_ports[i] = rte_cpu_to_be_16((i % nr_flows) + 1);
+		rte_exit(EXIT_FAILURE, "Cannot alloc the control blocks of %lu flows.\n", nr_flows);
 	}
 
 	for (uint32_t i = 0; i < nr_flows; i++)
 	{
 		rte_atomic16_init(&tcp_control_blocks[i].tcb_state);
 		rte_atomic16_set(&tcp_control_blocks[i].tcb_state, TCP_INIT);
-		rte_atomic16_set(&tcp_control_blocks[i].tcb_rwin, 0xFFFF);
+		rte_atomic32_set(&tcp_control_blocks[i].tcb_rwin, 0xFFFF);
 
-		src_tcp_port = src_ports[i];
-
-		tcp_control_blocks[i].src_addr = src_ipv4_addr;
+		// consecutive flows use consecutive source ports, then move to the next source address
+		tcp_control_blocks[i].src_addr = rte_cpu_to_be_32(rte_be_to_cpu_32(src_ipv4_addr) + i / nr_src_ports);
 		tcp_control_blocks[i].dst_addr = dst_ipv4_addr;
 
-		tcp_control_blocks[i].src_port = src_tcp_port;
+		tcp_control_blocks[i].src_port = rte_cpu_to_be_16(src_tcp_port_min + i % nr_src_ports);
 		tcp_control_blocks[i].dst_port = rte_cpu_to_be_16(dst_tcp_port);
 
 		uint32_t seq = rte_rand();
 		tcp_control_blocks[i].tcb_seq_ini = seq;
 		tcp_control_blocks[i].tcb_next_seq = seq;
 
-		tcp_control_blocks[i].flow_mark_action.id = i;
-		tcp_control_blocks[i].flow_queue_action.index = 0;
-		tcp_control_blocks[i].flow_eth.type = ETH_IPV4_TYPE_NETWORK;
-		tcp_control_blocks[i].flow_eth_mask.type = 0xFFFF;
-		tcp_control_blocks[i].flow_ipv4.hdr.src_addr = tcp_control_blocks[i].dst_addr;
-		tcp_control_blocks[i].flow_ipv4.hdr.dst_addr = tcp_control_blocks[i].src_addr;
-		tcp_control_blocks[i].flow_ipv4_mask.hdr.src_addr = 0xFFFFFFFF;
-		tcp_control_blocks[i].flow_ipv4_mask.hdr.dst_addr = 0xFFFFFFFF;
-		tcp_control_blocks[i].flow_tcp.hdr.src_port = tcp_control_blocks[i].dst_port;
-		tcp_control_blocks[i].flow_tcp.hdr.dst_port = tcp_control_blocks[i].src_port;
-		tcp_control_blocks[i].flow_tcp_mask.hdr.src_port = 0xFFFF;
-		tcp_control_blocks[i].flow_tcp_mask.hdr.dst_port = 0xFFFF;
+		build_tcp_hdr_template(&tcp_control_blocks[i]);
 	}
 }
 
 // Create the TCP SYN packet
-struct rte_mbuf *create_syn_packet(uint16_t i)
+struct rte_mbuf *create_syn_packet(uint32_t i)
 {
 	// allocate TCP SYN packet in the hugepages
 	struct rte_mbuf *pkt = rte_pktmbuf_alloc(pktmbuf_pool_tx);
@@ -112,7 +139,7 @@ struct rte_mbuf *create_syn_packet(uint16_t i)
 }
 
 // Create the TCP ACK packet
-struct rte_mbuf *create_ack_packet(uint16_t i)
+struct rte_mbuf *create_ack_packet(uint32_t i)
 {
 	// allocate TCP ACK packet in the hugepages
 	struct rte_mbuf *pkt = rte_pktmbuf_alloc(pktmbuf_pool_tx);
@@ -168,6 +195,35 @@ struct rte_mbuf *create_ack_packet(uint16_t i)
 	return pkt;
 }
 
+// Window scale advertised in the options of the SYN+ACK (0 if the server does not scale its window)
+static uint8_t parse_window_scale(struct rte_tcp_hdr *tcp_hdr)
+{
+	uint8_t *opt = (uint8_t *)(tcp_hdr + 1);
+	uint8_t *end = ((uint8_t *)tcp_hdr) + (tcp_hdr->data_off >> 4) * 4;
+
+	while (opt < end && *opt != TCP_OPT_EOL)
+	{
+		if (*opt == TCP_OPT_NOP)
+		{
+			opt++;
+			continue;
+		}
+
+		// every other option has a length byte
+		if (opt + 1 >= end || opt[1] < 2 || opt + opt[1] > end)
+		{
+			break;
+		}
+		if (opt[0] == TCP_OPT_WSCALE && opt[1] == 3)
+		{
+			return RTE_MIN(opt[2], (uint8_t)TCP_MAX_WSCALE);
+		}
+		opt += opt[1];
+	}
+
+	return 0;
+}
+
 // Process the TCP SYN+ACK packet and return the TCP ACK
 struct rte_mbuf *process_syn_ack_packet(struct rte_mbuf *pkt)
 {
@@ -190,6 +246,10 @@ struct rte_mbuf *process_syn_ack_packet(struct rte_mbuf *pkt)
 
 	// retrieve the index of the flow from the NIC (NIC tags the packet according the 5-tuple using DPDK rte_flow)
 	uint32_t idx = pkt->hash.fdir.hi;
+	if (idx >= nr_flows)
+	{
+		return NULL;
+	}
 
 	// get control block for the flow
 	tcp_control_block_t *block = &tcp_control_blocks[idx];
@@ -211,6 +271,13 @@ struct rte_mbuf *process_syn_ack_packet(struct rte_mbuf *pkt)
 		rte_atomic32_set(&block->tcb_next_ack, rte_cpu_to_be_32(seq + 1));
 		block->tcb_ack_ini = tcp_hdr->sent_seq;
 
+		// nothing is unacked yet
+		block->last_ack_recv = tcp_hdr->recv_ack;
+
+		// the window of the SYN+ACK itself is never scaled, the windows of the next segments are
+		block->snd_wscale = parse_window_scale(tcp_hdr);
+		rte_atomic32_set(&block->tcb_rwin, rte_be_to_cpu_16(tcp_hdr->rx_win));
+
 		// return TCP ACK packet
 		return create_ack_packet(idx);
 	}
@@ -218,61 +285,112 @@ struct rte_mbuf *process_syn_ack_packet(struct rte_mbuf *pkt)
 	return NULL;
 }
 
-// Fill the TCP packets from TCP Control Block data
-void fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt)
+// Set the size of a data packet, chaining more mbufs when the frame does not fit in one and asking for segmentation when the payload exceeds the MSS
+static void fill_tcp_frame(struct rte_mbuf *pkt, uint32_t payload_size)
 {
-	// ensure that IP/TCP checksum offloadings
-	pkt->ol_flags |= (RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM | RTE_MBUF_F_TX_TCP_CKSUM);
+	uint32_t length = sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + payload_size;
+	uint32_t left;
 
-	// fill Ethernet information
-	struct rte_ether_hdr *eth_hdr = (struct rte_ether_hdr *)rte_pktmbuf_mtod(pkt, struct ether_hdr *);
-	eth_hdr->dst_addr = dst_eth_addr;
-	eth_hdr->src_addr = src_eth_addr;
-	eth_hdr->ether_type = ETH_IPV4_TYPE_NETWORK;
+	if (zero_copy)
+	{
+		// only the headers and the request header are written, the rest points to a shared read-only payload
+		pkt->data_len = RTE_MIN(length, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + header_size);
+		pkt->pkt_len = pkt->data_len;
+		if (length > pkt->data_len)
+		{
+			attach_shared_payload(pkt, length - pkt->data_len);
+		}
+		left = 0;
+	}
+	else
+	{
+		pkt->data_len = RTE_MIN(length, rte_pktmbuf_tailroom(pkt));
+		pkt->pkt_len = pkt->data_len;
+		left = length - pkt->data_len;
+	}
 
-	// fill IPv4 information
+	// the payload continues in mbufs of the same pool (it is never read, so they are left as they are)
+	while (left > 0)
+	{
+		struct rte_mbuf *seg = rte_pktmbuf_alloc(pktmbuf_pool_tx);
+		if (seg == NULL || rte_pktmbuf_chain(pkt, seg) != 0)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot chain the mbufs of a request.\n");
+		}
+		seg->data_len = RTE_MIN(left, rte_pktmbuf_tailroom(seg));
+		pkt->pkt_len += seg->data_len;
+		left -= seg->data_len;
+	}
+
+	if (payload_size <= tcp_mss)
+	{
+		return;
+	}
+
+	// the NIC (TSO) or rte_gso (software) splits the request into MSS-sized segments, copying the headers and advancing the SEQ
+	pkt->ol_flags |= RTE_MBUF_F_TX_TCP_SEG;
+	pkt->l2_len = sizeof(struct rte_ether_hdr);
+	pkt->l3_len = sizeof(struct rte_ipv4_hdr);
+	pkt->l4_len = sizeof(struct rte_tcp_hdr);
+	pkt->tso_segsz = tcp_mss;
+
+	// TSO expects the pseudo-header checksum without the length
 	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
-	ipv4_hdr->version_ihl = 0x45;
-	ipv4_hdr->total_length = rte_cpu_to_be_16(frame_size - sizeof(struct rte_ether_hdr));
-	ipv4_hdr->time_to_live = 255;
-	ipv4_hdr->packet_id = 0;
-	ipv4_hdr->next_proto_id = IPPROTO_TCP;
-	ipv4_hdr->fragment_offset = 0;
-	ipv4_hdr->src_addr = block->src_addr;
-	ipv4_hdr->dst_addr = block->dst_addr;
-	ipv4_hdr->hdr_checksum = 0;
+	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	tcp_hdr->cksum = rte_ipv4_phdr_cksum(ipv4_hdr, pkt->ol_flags);
+}
+
+// Fill the TCP packets from TCP Control Block data (payload_size bytes of TCP payload)
+void fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt, uint32_t payload_size)
+{
+	// ensure that IP/TCP checksum offloadings
+	pkt->ol_flags |= (RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM | RTE_MBUF_F_TX_TCP_CKSUM);
+
+	// copy the pre-rendered Ethernet, IPv4, and TCP headers
+	rte_mov64(rte_pktmbuf_mtod(pkt, uint8_t *), block->tcb_hdr_template);
 
 	// set the TCP SEQ number
 	uint32_t sent_seq = block->tcb_next_seq;
 
-	// fill TCP information
+	// fill TCP SEQ and ACK numbers
 	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
-	tcp_hdr->dst_port = block->dst_port;
-	tcp_hdr->src_port = block->src_port;
 	tcp_hdr->sent_seq = sent_seq;
 	tcp_hdr->recv_ack = rte_atomic32_read(&block->tcb_next_ack);
-	tcp_hdr->data_off = (sizeof(struct rte_tcp_hdr) >> 2) << 4;
-	tcp_hdr->tcp_flags = RTE_TCP_PSH_FLAG | RTE_TCP_ACK_FLAG;
-	tcp_hdr->rx_win = 0xFFFF;
-	tcp_hdr->cksum = 0;
-	tcp_hdr->tcp_urp = 0;
 
 	// updates the TCP SEQ number
-	sent_seq = rte_cpu_to_be_32(rte_be_to_cpu_32(sent_seq) + tcp_payload_size);
+	sent_seq = rte_cpu_to_be_32(rte_be_to_cpu_32(sent_seq) + payload_size);
 	block->tcb_next_seq = sent_seq;
 
+	// the template carries the length of the largest request
+	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	ipv4_hdr->total_length = rte_cpu_to_be_16(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + payload_size);
+
 	// fill the packet size
-	pkt->data_len = frame_size;
-	pkt->pkt_len = pkt->data_len;
+	fill_tcp_frame(pkt, payload_size);
 }
 
-void hot_fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt)
+// Fill a data packet again from the SEQ number given (retransmission), leaving the next SEQ number untouched
+void fill_tcp_retransmission(tcp_control_block_t *block, struct rte_mbuf *pkt, uint32_t seq)
 {
-	// get IPv4 information
-	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	// ensure that IP/TCP checksum offloadings
+	pkt->ol_flags |= (RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM | RTE_MBUF_F_TX_TCP_CKSUM);
 
-	// fill TCP information
-	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) + (ipv4_hdr->version_ihl & 0x0f) * 4);
+	// copy the pre-rendered Ethernet, IPv4, and TCP headers
+	rte_mov64(rte_pktmbuf_mtod(pkt, uint8_t *), block->tcb_hdr_template);
+
+	// fill TCP SEQ and ACK numbers
+	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	tcp_hdr->sent_seq = seq;
+	tcp_hdr->recv_ack = rte_atomic32_read(&block->tcb_next_ack);
+
+	// fill the packet size
+	fill_tcp_frame(pkt, tcp_payload_size);
+}
+
+void hot_fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt)
+{
+	// fill TCP information (data packets are built from the template, so the IPv4 header has no options)
+	struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
 
 	// fill TCP ACK information
 	tcp_hdr->recv_ack = rte_atomic32_read(&block->tcb_next_ack);
@@ -15,6 +15,7 @@
 #include <rte_atomic.h>
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
+#include <rte_memcpy.h>
 #include <rte_mempool.h>
 
 // TCP State enum
@@ -34,41 +35,57 @@ typedef enum
 	TCP_CLOSED,
 } tcb_state_t;
 
+#define TCP_HDR_TEMPLATE_SIZE 64
+#define TCP_OPT_EOL 0
+#define TCP_OPT_NOP 1
+#define TCP_OPT_WSCALE 3
+#define TCP_MAX_WSCALE 14
+
 // TCP Control Block
 typedef struct tcp_control_block_s
 {
-	// used only by the TX
+	// used only by the TX (Ethernet + IPv4 + TCP headers, padded with zeroed payload to one cache line)
+	uint8_t tcb_hdr_template[TCP_HDR_TEMPLATE_SIZE];
 	uint32_t tcb_next_seq;
 	uint32_t src_addr;
 	uint32_t dst_addr;
 	uint16_t src_port;
 	uint16_t dst_port;
-	uint64_t instructions;
-	double randomness;
 
-	// used only by the RX
-	uint32_t last_ack_recv;
-	uint32_t last_seq_recv;
+	// used only by the retransmission timer of the TX (rto_tsc is 0 when the timer is not armed)
+	uint32_t rto_seq;
+	uint64_t rto_tsc;
 
-	// used by both RX/TX
+	// used only by the RX (rx_frame_off is the offset of the next expected byte in its response of rx_frame_len bytes, rx_t0/rx_f_id/rx_w_id the header of the response in progress)
+	uint32_t last_seq_recv;
+	uint32_t rx_frame_off;
+	uint32_t rx_frame_len;
+	uint8_t rx_header_valid;
+	uint64_t rx_t0;
+	uint64_t rx_f_id;
+	uint64_t rx_w_id;
+	uint8_t snd_wscale;
+
+	// used by both RX/TX (last_ack_recv is the oldest unacked SEQ, written by the RX only; tcb_rwin is the receive
+	// window of the server in bytes, in host order with its window scale applied)
+	uint32_t last_ack_recv;
 	rte_atomic32_t tcb_next_ack;
 	rte_atomic16_t tcb_state;
-	rte_atomic16_t tcb_rwin;
+	rte_atomic32_t tcb_rwin;
 
 	// used only in the beginning
 	uint32_t tcb_seq_ini;
 	uint32_t tcb_ack_ini;
-	struct rte_flow_item_eth flow_eth;
-	struct rte_flow_item_eth flow_eth_mask;
-	struct rte_flow_item_ipv4 flow_ipv4;
-	struct rte_flow_item_ipv4 flow_ipv4_mask;
-	struct rte_flow_item_tcp flow_tcp;
-	struct rte_flow_item_tcp flow_tcp_mask;
-	struct rte_flow_action_mark flow_mark_action;
-	struct rte_flow_action_queue flow_queue_action;
-
 } __rte_cache_aligned tcp_control_block_t;
 
+// Flow with a SYN in flight during the startup
+typedef struct handshake_slot_s
+{
+	uint32_t flow;
+	uint32_t nb_syn;
+	uint64_t ts_syn;
+} handshake_slot_t;
+
 typedef struct tcp_options_ws_s
 {
 	uint8_t kind;
@@ -87,30 +104,44 @@ typedef struct tcp_options_mss_s
 #define ETH_IPV4_TYPE_NETWORK 0x0008
 #define HANDSHAKE_TIMEOUT_IN_US 500000
 #define HANDSHAKE_RETRANSMISSION 4
+#define HANDSHAKE_WINDOW 1024
+#define TX_SEG_NONE 0
+#define TX_SEG_TSO 1
+#define TX_SEG_SOFTWARE 2
 #define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
 #define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
 
 extern uint16_t dst_tcp_port;
 extern uint32_t dst_ipv4_addr;
 extern uint32_t src_ipv4_addr;
+extern uint32_t src_ipv4_count;
+extern uint16_t src_tcp_port_min;
+extern uint16_t src_tcp_port_max;
 extern struct rte_ether_addr dst_eth_addr;
 extern struct rte_ether_addr src_eth_addr;
 
 extern uint64_t srv_instructions;
 
+extern uint16_t portid;
 extern uint64_t nr_flows;
+extern uint32_t nr_rx_queues;
 extern uint32_t frame_size;
 extern uint32_t tcp_payload_size;
+extern uint32_t tcp_mss;
+extern uint8_t tx_segmentation;
+extern uint8_t zero_copy;
+extern uint32_t header_size;
 extern struct rte_mempool *pktmbuf_pool_rx;
 extern struct rte_mempool *pktmbuf_pool_tx;
 extern tcp_control_block_t *tcp_control_blocks;
 
 void init_tcp_blocks();
-struct rte_mbuf *create_syn_packet(uint16_t i);
-struct rte_mbuf *create_ack_packet(uint16_t i);
-void fill_tcp_payload(uint8_t *payload, uint32_t length);
+struct rte_mbuf *create_syn_packet(uint32_t i);
+struct rte_mbuf *create_ack_packet(uint32_t i);
+void attach_shared_payload(struct rte_mbuf *pkt, uint32_t len);
 struct rte_mbuf *process_syn_ack_packet(struct rte_mbuf *pkt);
-void fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt);
+void fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt, uint32_t payload_size);
 void hot_fill_tcp_packet(tcp_control_block_t *block, struct rte_mbuf *pkt);
+void fill_tcp_retransmission(tcp_control_block_t *block, struct rte_mbuf *pkt, uint32_t seq);
 
 #endif // __TCP_UTIL_H__
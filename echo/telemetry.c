@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+
+#include "dpdk_util.h"
+#include "telemetry.h"
+
+// Totals of the live counters of all lcores
+typedef struct live_totals_t
+{
+	uint64_t tx_pkts;
+	uint64_t never_sent;
+	uint64_t retransmitted;
+	uint64_t rx_pkts;
+	uint64_t rx_processed;
+	uint64_t received;
+	uint64_t schedule_ring;
+	uint64_t completion_ring;
+} live_totals_t;
+
+// Merged histograms of the current phase (one for the telemetry thread, one for the live stats line)
+static histogram_t *telemetry_histogram;
+static histogram_t *live_histogram;
+
+// Sum the counters (relaxed loads only, the hot loops are never stopped)
+static void read_live_totals(live_totals_t *t)
+{
+	memset(t, 0, sizeof(live_totals_t));
+
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH(lcore_id)
+	{
+		lcore_counters_t *c = &lcore_counters[lcore_id];
+		t->tx_pkts += __atomic_load_n(&c->tx_pkts, __ATOMIC_RELAXED);
+		t->never_sent += __atomic_load_n(&c->never_sent, __ATOMIC_RELAXED);
+		t->retransmitted += __atomic_load_n(&c->retransmitted, __ATOMIC_RELAXED);
+		t->rx_pkts += __atomic_load_n(&c->rx_pkts, __ATOMIC_RELAXED);
+		t->rx_processed += __atomic_load_n(&c->rx_processed, __ATOMIC_RELAXED);
+	}
+
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
+	{
+		for (uint32_t p = 0; p < nr_phases; p++)
+		{
+			if (rx_results[q].histograms[p])
+			{
+				t->received += __atomic_load_n(&rx_results[q].histograms[p]->total, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		t->schedule_ring += schedule_rings[q] ? rte_ring_count(schedule_rings[q]) : 0;
+		t->completion_ring += completion_rings[q] ? rte_ring_count(completion_rings[q]) : 0;
+	}
+}
+
+// Phase running now, from the boundaries set at the start of the run (-1 before the run or the current probe starts)
+static int current_phase(uint64_t now)
+{
+	if (tx_start_tsc == 0 || phases[0].start_tsc == UINT64_MAX || now < phases[0].start_tsc)
+	{
+		return -1;
+	}
+
+	// the phase found must be the one whose part of the schedule contains now
+	uint32_t p = find_phase(now);
+	if (now < phases[p].start_tsc || (p + 1 < nr_phases && now >= phases[p + 1].start_tsc))
+	{
+		return -1;
+	}
+
+	return p;
+}
+
+// Merge the histograms of the phase of all RX queues into live (its percentiles are approximate while the RX lcores record)
+static histogram_t *current_histogram(histogram_t *live, int phase)
+{
+	if (phase < 0 || live == NULL)
+	{
+		return NULL;
+	}
+
+	histogram_reset(live);
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
+	{
+		histogram_merge(live, rx_results[q].histograms[phase]);
+	}
+
+	return live;
+}
+
+// Telemetry: aggregated counters, ring occupancy, and running percentiles
+static int telemetry_stats(const char *cmd, const char *params, struct rte_tel_data *d)
+{
+	live_totals_t t;
+	read_live_totals(&t);
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "tx_pkts", t.tx_pkts);
+	rte_tel_data_add_dict_u64(d, "never_sent", t.never_sent);
+	rte_tel_data_add_dict_u64(d, "retransmitted", t.retransmitted);
+	rte_tel_data_add_dict_u64(d, "rx_pkts", t.rx_pkts);
+	rte_tel_data_add_dict_u64(d, "rx_processed", t.rx_processed);
+	rte_tel_data_add_dict_u64(d, "received", t.received);
+	rte_tel_data_add_dict_u64(d, "rx_ring", rx_ring ? rte_ring_count(rx_ring) : 0);
+	rte_tel_data_add_dict_u64(d, "schedule_rings", t.schedule_ring);
+	rte_tel_data_add_dict_u64(d, "completion_rings", t.completion_ring);
+
+	int phase = current_phase(rte_rdtsc());
+	histogram_t *h = current_histogram(telemetry_histogram, phase);
+	if (h)
+	{
+		rte_tel_data_add_dict_u64(d, "phase", phase);
+		rte_tel_data_add_dict_u64(d, "p50_ns", histogram_percentile(h, 50));
+		rte_tel_data_add_dict_u64(d, "p99_ns", histogram_percentile(h, 99));
+		rte_tel_data_add_dict_u64(d, "p999_ns", histogram_percentile(h, 99.9));
+	}
+
+	return 0;
+}
+
+// Telemetry: counters of one lcore (the lcore id is the parameter)
+static int telemetry_lcore(const char *cmd, const char *params, struct rte_tel_data *d)
+{
+	if (params == NULL || *params == '\0')
+	{
+		return -1;
+	}
+
+	char *end;
+	unsigned long lcore_id = strtoul(params, &end, 10);
+	if (*end != '\0' || lcore_id >= RTE_MAX_LCORE || !rte_lcore_is_enabled(lcore_id))
+	{
+		return -1;
+	}
+
+	lcore_counters_t *c = &lcore_counters[lcore_id];
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "tx_pkts", __atomic_load_n(&c->tx_pkts, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_u64(d, "never_sent", __atomic_load_n(&c->never_sent, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_u64(d, "retransmitted", __atomic_load_n(&c->retransmitted, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_u64(d, "rx_pkts", __atomic_load_n(&c->rx_pkts, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_u64(d, "rx_processed", __atomic_load_n(&c->rx_processed, __ATOMIC_RELAXED));
+
+	return 0;
+}
+
+// Register the telemetry commands (dpdk-telemetry.py, e.g., "/load_generator/stats")
+void register_telemetry()
+{
+	telemetry_histogram = histogram_create(histogram_digits);
+	live_histogram = histogram_create(histogram_digits);
+	if (telemetry_histogram == NULL || live_histogram == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the live histograms.\n");
+	}
+
+	rte_telemetry_register_cmd(TELEMETRY_STATS_CMD, telemetry_stats,
+														 "Returns the live counters of the run. Takes no parameters");
+	rte_telemetry_register_cmd(TELEMETRY_LCORE_CMD, telemetry_lcore,
+														 "Returns the live counters of an lcore. Parameters: int lcore_id");
+}
+
+// Print one line with the rates over the last call and the running percentiles to stderr
+void print_live_stats()
+{
+	static live_totals_t prev;
+	static uint64_t prev_tsc;
+
+	live_totals_t t;
+	read_live_totals(&t);
+	uint64_t now = rte_rdtsc();
+
+	double elapsed = prev_tsc ? (double)(now - prev_tsc) / (TICKS_PER_US * 1000000.0) : 1.0;
+	histogram_t *h = current_histogram(live_histogram, current_phase(now));
+
+	fprintf(stderr, "tx = %lu (%.0f pps) -- rx = %lu (%.0f pps) -- never_sent = %lu -- retransmitted = %lu -- rx_ring = %u -- 50p = %lu -- 99p = %lu -- 99.9p = %lu ns\n",
+					t.tx_pkts, (t.tx_pkts - prev.tx_pkts) / elapsed,
+					t.received, (t.received - prev.received) / elapsed,
+					t.never_sent, t.retransmitted, rx_ring ? rte_ring_count(rx_ring) : 0,
+					h ? histogram_percentile(h, 50) : 0,
+					h ? histogram_percentile(h, 99) : 0,
+					h ? histogram_percentile(h, 99.9) : 0);
+
+	prev = t;
+	prev_tsc = now;
+}
+
+// Release the merged histograms
+void free_telemetry()
+{
+	histogram_free(telemetry_histogram);
+	histogram_free(live_histogram);
+	telemetry_histogram = NULL;
+	live_histogram = NULL;
+}
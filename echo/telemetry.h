@@ -0,0 +1,15 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <rte_telemetry.h>
+
+#include "util.h"
+
+#define TELEMETRY_STATS_CMD "/load_generator/stats"
+#define TELEMETRY_LCORE_CMD "/load_generator/lcore"
+
+void register_telemetry();
+void print_live_stats();
+void free_telemetry();
+
+#endif // __TELEMETRY_H__
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include <rte_eal.h>
+
+#include "timer_wheel.h"
+
+// Create an empty wheel whose first tick is start_tsc
+timer_wheel_t *timer_wheel_create(uint32_t capacity, uint64_t tick_tsc, uint64_t start_tsc)
+{
+	timer_wheel_t *w = (timer_wheel_t *)rte_zmalloc(NULL, sizeof(timer_wheel_t), 64);
+	if (w == NULL)
+	{
+		return NULL;
+	}
+
+	w->capacity = capacity;
+	w->tick_tsc = tick_tsc;
+	w->now = start_tsc / tick_tsc;
+	w->next = (uint32_t *)rte_malloc(NULL, capacity * sizeof(uint32_t), 64);
+	w->expiry = (uint64_t *)rte_malloc(NULL, capacity * sizeof(uint64_t), 64);
+	if (w->next == NULL || w->expiry == NULL)
+	{
+		timer_wheel_free(w);
+		return NULL;
+	}
+	memset(w->slots, 0xff, sizeof(w->slots));
+
+	return w;
+}
+
+// Link the timer of the id into the slot that covers its expiry tick
+static void timer_wheel_insert(timer_wheel_t *w, uint32_t id)
+{
+	uint64_t tick = RTE_MAX(w->expiry[id], w->now);
+	uint64_t delta = tick - w->now;
+
+	uint32_t level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_BITS * (level + 1))))
+	{
+		level++;
+	}
+
+	// timers beyond the last level wait in its farthest slot and cascade again
+	if (delta >= (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)))
+	{
+		tick = w->now + (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	}
+
+	uint32_t *head = &w->slots[level][(tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	w->next[id] = *head;
+	*head = id;
+}
+
+// Arm the timer of the id (which must not be armed)
+void timer_wheel_add(timer_wheel_t *w, uint32_t id, uint64_t expiry_tsc)
+{
+	w->expiry[id] = expiry_tsc / w->tick_tsc;
+	w->nr_timers++;
+	timer_wheel_insert(w, id);
+}
+
+// Move the timers of the current slot of the level to the levels below
+static void timer_wheel_cascade(timer_wheel_t *w, uint32_t level)
+{
+	uint32_t *head = &w->slots[level][(w->now >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	uint32_t id = *head;
+	*head = TIMER_WHEEL_NONE;
+
+	while (id != TIMER_WHEEL_NONE)
+	{
+		uint32_t next = w->next[id];
+		timer_wheel_insert(w, id);
+		id = next;
+	}
+}
+
+// Advance the wheel up to now_tsc and return up to max expired ids (the remaining ones are returned by the next call)
+uint32_t timer_wheel_expire(timer_wheel_t *w, uint64_t now_tsc, uint32_t *ids, uint32_t max)
+{
+	uint32_t n = 0;
+	uint64_t target = now_tsc / w->tick_tsc;
+
+	while (w->nr_timers > 0 && w->now <= target)
+	{
+		uint32_t *head = &w->slots[0][w->now & TIMER_WHEEL_MASK];
+		while (*head != TIMER_WHEEL_NONE && n < max)
+		{
+			ids[n++] = *head;
+			*head = w->next[*head];
+			w->nr_timers--;
+		}
+
+		// no more room, so the slot is finished in the next call
+		if (*head != TIMER_WHEEL_NONE || w->now == target)
+		{
+			return n;
+		}
+
+		// a new lap of a level brings down the timers of the next slot of the level above
+		w->now++;
+		for (uint32_t level = 1; level < TIMER_WHEEL_LEVELS && (w->now & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) == 0; level++)
+		{
+			timer_wheel_cascade(w, level);
+		}
+	}
+
+	// an empty wheel just follows the time
+	if (w->nr_timers == 0 && w->now < target)
+	{
+		w->now = target;
+	}
+
+	return n;
+}
+
+// Free the wheel
+void timer_wheel_free(timer_wheel_t *w)
+{
+	if (w == NULL)
+	{
+		return;
+	}
+
+	rte_free(w->next);
+	rte_free(w->expiry);
+	rte_free(w);
+}
@@ -0,0 +1,32 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdint.h>
+
+#include <rte_malloc.h>
+
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 3
+#define TIMER_WHEEL_NONE UINT32_MAX
+
+// Hierarchical timer wheel over the ids 0..capacity-1 (at most one timer per id): level 0 has one slot per tick,
+// each upper level one slot per lap of the level below, and timers cascade down as their slot comes up
+typedef struct timer_wheel_t
+{
+	uint32_t capacity;
+	uint64_t tick_tsc;
+	uint64_t now;
+	uint64_t nr_timers;
+	uint32_t *next;
+	uint64_t *expiry;
+	uint32_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+timer_wheel_t *timer_wheel_create(uint32_t capacity, uint64_t tick_tsc, uint64_t start_tsc);
+void timer_wheel_add(timer_wheel_t *w, uint32_t id, uint64_t expiry_tsc);
+uint32_t timer_wheel_expire(timer_wheel_t *w, uint64_t now_tsc, uint32_t *ids, uint32_t max);
+void timer_wheel_free(timer_wheel_t *w);
+
+#endif // __TIMER_WHEEL_H__
@@ -1,4 +1,9 @@
+#include "rng.h"
+#include "alias.h"
 #include "util.h"
+#include "header.h"
+#include "writer.h"
+#include "telemetry.h"
 
 double srv_mode;
 uint64_t srv_distribution;
@@ -7,29 +12,48 @@ uint64_t srv_iterations1;
 
 int distribution;
 char output_file[MAXSTRLEN];
+char bin_output_file[MAXSTRLEN];
+char empirical_file[MAXSTRLEN];
+char phases_spec[MAXSTRLEN * 8];
+uint64_t probe_duration;
+alias_table_t *interarrival_table;
 
-// Sample the value using Exponential Distribution
-double sample_exponential(double lambda)
+int flow_policy = FLOW_ROUND_ROBIN;
+double zipf_skew;
+double hot_traffic;
+double hot_flows;
+uint32_t nr_hot_flows;
+uint64_t on_time_us;
+uint64_t off_time_us;
+alias_table_t *zipf_table;
+
+char request_sizes_spec[MAXSTRLEN];
+char response_sizes_spec[MAXSTRLEN];
+size_distribution_t request_sizes = {.type = CONSTANT_VALUE};
+size_distribution_t response_sizes = {.type = ECHO_VALUE};
+histogram_t *size_histograms[SIZE_CLASSES];
+
+// one block of the streamed schedule before it is split between the TX lcores (only the producer lcore uses them)
+static uint64_t stream_interarrival[SCHEDULE_CHUNK_ELEMENTS];
+static uint32_t stream_flow_indexes[SCHEDULE_CHUNK_ELEMENTS];
+
+// Sample the value using Exponential Distribution (u is uniform in (0,1))
+double sample_exponential(double lambda, double u)
 {
-	double u = (double)rand() / RAND_MAX; // Uniform random number [0,1]
 	return -log(1 - u) / lambda;
 }
 
-// Sample the value using Log-Normal Distribution
-double sample_lognormal(double mu, double sigma)
+// Sample the value using Log-Normal Distribution (u1 and u2 are uniform in (0,1))
+double sample_lognormal(double mu, double sigma, double u1, double u2)
 {
-	double u1 = ((double)rand() / RAND_MAX); // Uniform random number [0,1]
-	double u2 = ((double)rand() / RAND_MAX); // Uniform random number [0,1]
-
 	double z = sqrt(-2.0 * log(u1)) * cos(2 * M_PI * u2);
 
 	return exp(mu + sigma * z);
 }
 
-// Sample the value using Pareto Distribution
-double sample_pareto(double alpha, double xm)
+// Sample the value using Pareto Distribution (u is uniform in (0,1))
+double sample_pareto(double alpha, double xm, double u)
 {
-	double u = (double)rand() / RAND_MAX; // Uniform random number [0,1]
 	return xm / pow(1 - u, 1.0 / alpha);
 }
 
@@ -49,166 +73,1209 @@ static double process_double_arg(const char *arg)
 	return strtod(arg, &end);
 }
 
-// Allocate and create all application nodes
-void create_application_array()
+// Sample the size of the request idx (no random draw when all sizes are the same)
+static inline uint32_t sample_size(const size_distribution_t *dist, uint32_t stream, uint64_t idx)
 {
-	uint64_t nr_elements = rate * duration;
+	if (dist->min == dist->max)
+	{
+		return dist->min;
+	}
 
-	application_array = (application_node_t *)rte_malloc(NULL, nr_elements * sizeof(application_node_t), 64);
-	if (application_array == NULL)
+	rng_block_t r = rng_philox(seed, stream, idx);
+	if (dist->type == BIMODAL_VALUE)
 	{
-		rte_exit(EXIT_FAILURE, "Cannot alloc the application array.\n");
+		return rng_u01(r.x0) < dist->mode ? dist->value0 : dist->value1;
 	}
 
-	if (srv_distribution == CONSTANT_VALUE)
+	return (uint32_t)dist->table->values[alias_sample(dist->table, r.x0, r.x1)];
+}
+
+// Fill the server work and the sizes of n consecutive requests, starting at the request first
+static void fill_application(application_node_t *nodes, uint64_t first, uint64_t n)
+{
+	for (uint64_t j = 0; j < n; j++)
 	{
-		for (uint32_t j = 0; j < nr_elements; j++)
+		rng_block_t r = rng_philox(seed, RNG_STREAM_APPLICATION, first + j);
+		double u = rng_u01(r.x0);
+
+		if (srv_distribution == CONSTANT_VALUE)
+		{
+			nodes[j].iterations = srv_iterations0;
+		}
+		else if (srv_distribution == EXPONENTIAL_VALUE)
+		{
+			nodes[j].iterations = (uint64_t)(-((double)srv_iterations0) * log(u));
+		}
+		else if (u < srv_mode)
+		{
+			nodes[j].iterations = srv_iterations0;
+		}
+		else
 		{
-			application_array[j].iterations = srv_iterations0;
-			application_array[j].randomness = rte_rand();
+			nodes[j].iterations = srv_iterations1;
 		}
+		nodes[j].randomness = r.x1;
+
+		// the sizes come from their own streams, so the server work is the same with or without them
+		nodes[j].request_size = sample_size(&request_sizes, RNG_STREAM_REQUEST_SIZE, first + j);
+		if (response_sizes.type == ECHO_VALUE)
+		{
+			nodes[j].response_size = nodes[j].request_size;
+		}
+		else
+		{
+			nodes[j].response_size = sample_size(&response_sizes, RNG_STREAM_RESPONSE_SIZE, first + j);
+		}
+	}
+}
+
+// Mean interarrival gap (in us) of the element k of the phase (the rate of a linear ramp after k elements is closed-form)
+static inline double phase_mean_gap(const phase_t *phase, uint64_t k)
+{
+	if (phase->rate_start == phase->rate_end)
+	{
+		return 1000000.0 / phase->rate_start;
 	}
-	else if (srv_distribution == EXPONENTIAL_VALUE)
+
+	double slope = (phase->rate_end - phase->rate_start) / phase->duration;
+	double cur_rate = sqrt(phase->rate_start * phase->rate_start + 2.0 * slope * k);
+
+	return 1000000.0 / RTE_MAX(cur_rate, 1.0);
+}
+
+// Fill n consecutive interarrival gaps (in ticks) of the phase, starting at the request first
+static void fill_phase_interarrival(const phase_t *phase, uint64_t *gaps, uint64_t first, uint64_t n)
+{
+	uint64_t k = first - phase->first;
+
+	if (phase->distribution == UNIFORM_VALUE)
 	{
-		for (uint32_t j = 0; j < nr_elements; j++)
+		// Uniform
+		for (uint64_t j = 0; j < n; j++)
+		{
+			double mean = phase_mean_gap(phase, k + j);
+			gaps[j] = mean * TICKS_PER_US;
+		}
+	}
+	else if (phase->distribution == EXPONENTIAL_VALUE)
+	{
+		// Exponential
+		for (uint64_t j = 0; j < n; j++)
+		{
+			double lambda = 1.0 / phase_mean_gap(phase, k + j);
+			rng_block_t r = rng_philox(seed, RNG_STREAM_INTERARRIVAL, first + j);
+			gaps[j] = sample_exponential(lambda, rng_u01(r.x0)) * TICKS_PER_US;
+		}
+	}
+	else if (phase->distribution == LOGNORMAL_VALUE)
+	{
+		// Log-normal
+		for (uint64_t j = 0; j < n; j++)
+		{
+			double mean = phase_mean_gap(phase, k + j);
+			double sigma = sqrt(2 * (log(mean) - log(mean / 2)));
+			double u = log(mean) - (sigma * sigma) / 2;
+			rng_block_t r = rng_philox(seed, RNG_STREAM_INTERARRIVAL, first + j);
+			gaps[j] = sample_lognormal(u, sigma, rng_u01(r.x0), rng_u01(r.x1)) * TICKS_PER_US;
+		}
+	}
+	else if (phase->distribution == PARETO_VALUE)
+	{
+		// Pareto
+		for (uint64_t j = 0; j < n; j++)
 		{
-			double u = rte_drand();
-			application_array[j].iterations = (uint64_t)(-((double)srv_iterations0) * log(u));
-			application_array[j].randomness = rte_rand();
+			double mean = phase_mean_gap(phase, k + j);
+			double alpha = 1.0 + mean / (mean - 1.0);
+			double xm = mean * (alpha - 1) / (alpha);
+			rng_block_t r = rng_philox(seed, RNG_STREAM_INTERARRIVAL, first + j);
+			gaps[j] = sample_pareto(alpha, xm, rng_u01(r.x0)) * TICKS_PER_US;
+		}
+	}
+	else if (phase->distribution == EMPIRICAL_VALUE)
+	{
+		// Empirical (alias table normalized to a mean of 1), in blocks so the RNG and the lookups vectorize
+		rng_block_t r[ALIAS_BLOCK_SIZE];
+		for (uint64_t j = 0; j < n; j += ALIAS_BLOCK_SIZE)
+		{
+			uint64_t len = RTE_MIN((uint64_t)ALIAS_BLOCK_SIZE, n - j);
+			for (uint64_t b = 0; b < len; b++)
+			{
+				r[b] = rng_philox(seed, RNG_STREAM_INTERARRIVAL, first + j + b);
+			}
+			for (uint64_t b = 0; b < len; b++)
+			{
+				uint32_t idx = alias_sample(interarrival_table, r[b].x0, r[b].x1);
+				gaps[j + b] = interarrival_table->values[idx] * phase_mean_gap(phase, k + j + b) * TICKS_PER_US;
+			}
 		}
 	}
 	else
 	{
-		for (uint32_t j = 0; j < nr_elements; j++)
+		exit(-1);
+	}
+}
+
+// Fill n consecutive interarrival gaps (in ticks), starting at the request first
+static void fill_interarrival(uint64_t *gaps, uint64_t first, uint64_t n)
+{
+	for (uint32_t p = 0; p < nr_phases && n > 0; p++)
+	{
+		phase_t *phase = &phases[p];
+		if (first >= phase->first + phase->nr_elements)
+		{
+			continue;
+		}
+
+		// part of the range that belongs to this phase
+		uint64_t len = RTE_MIN(n, phase->first + phase->nr_elements - first);
+		fill_phase_interarrival(phase, gaps, first, len);
+
+		gaps += len;
+		first += len;
+		n -= len;
+	}
+}
+
+// Sample the server work of the request idx
+void sample_application(application_node_t *node, uint64_t idx)
+{
+	fill_application(node, idx, 1);
+}
+
+// Expected send time (in us since the start) of the request idx, from the rates of the phases
+static double expected_arrival_us(uint64_t idx)
+{
+	double start_us = 0;
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		phase_t *phase = &phases[p];
+		if (idx < phase->first + phase->nr_elements || p == nr_phases - 1)
+		{
+			double k = idx - phase->first;
+			if (phase->rate_start == phase->rate_end)
+			{
+				return start_us + k * 1000000.0 / phase->rate_start;
+			}
+
+			// invert the number of requests sent after t seconds of a linear ramp
+			double slope = (phase->rate_end - phase->rate_start) / phase->duration;
+			double cur_rate = sqrt(phase->rate_start * phase->rate_start + 2.0 * slope * k);
+			return start_us + 1000000.0 * (cur_rate - phase->rate_start) / slope;
+		}
+		start_us += phase->duration * 1000000.0;
+	}
+
+	return start_us;
+}
+
+// Check whether the flow is in the ON period of its cycle at time t (each flow has its own offset in the cycle)
+static inline int flow_is_on(uint32_t flow, uint64_t t)
+{
+	uint64_t cycle = on_time_us + off_time_us;
+	uint64_t offset = rng_mix64(((uint64_t)seed << 32) | flow) % cycle;
+
+	return (t + offset) % cycle < on_time_us;
+}
+
+// Pick a flow for the request idx among the ones in their ON period (4 candidates per random block)
+static uint32_t sample_onoff_flow(uint64_t idx)
+{
+	uint64_t t = (uint64_t)expected_arrival_us(idx);
+	uint32_t candidate = 0;
+
+	for (uint32_t d = 0; d < ONOFF_MAX_DRAWS; d++)
+	{
+		rng_block_t r = rng_philox(seed, RNG_STREAM_FLOW | (d << 16), idx);
+		uint32_t x[4] = {(uint32_t)r.x0, (uint32_t)(r.x0 >> 32), (uint32_t)r.x1, (uint32_t)(r.x1 >> 32)};
+		for (int c = 0; c < 4; c++)
 		{
-			double u = rte_drand();
-			if (u < srv_mode)
+			candidate = rng_bounded(x[c], nr_flows);
+			if (flow_is_on(candidate, t))
 			{
-				application_array[j].iterations = srv_iterations0;
+				return candidate;
+			}
+		}
+	}
+
+	// (almost) no flow is ON, so keep the last candidate
+	return candidate;
+}
+
+// Fill the flow identifiers of n consecutive requests, starting at the request first
+static void fill_flow_indexes(uint32_t *flows, uint64_t first, uint64_t n)
+{
+	if (flow_policy == FLOW_ROUND_ROBIN)
+	{
+		for (uint64_t j = 0; j < n; j++)
+		{
+			flows[j] = (first + j) % nr_flows;
+		}
+	}
+	else if (flow_policy == FLOW_UNIFORM)
+	{
+		for (uint64_t j = 0; j < n; j++)
+		{
+			rng_block_t r = rng_philox(seed, RNG_STREAM_FLOW, first + j);
+			flows[j] = rng_bounded((uint32_t)r.x0, nr_flows);
+		}
+	}
+	else if (flow_policy == FLOW_ZIPF)
+	{
+		// the alias table over the ranks of the flows, in blocks so the RNG and the lookups vectorize
+		rng_block_t r[ALIAS_BLOCK_SIZE];
+		for (uint64_t j = 0; j < n; j += ALIAS_BLOCK_SIZE)
+		{
+			uint64_t len = RTE_MIN((uint64_t)ALIAS_BLOCK_SIZE, n - j);
+			for (uint64_t b = 0; b < len; b++)
+			{
+				r[b] = rng_philox(seed, RNG_STREAM_FLOW, first + j + b);
+			}
+			for (uint64_t b = 0; b < len; b++)
+			{
+				flows[j + b] = alias_sample(zipf_table, r[b].x0, r[b].x1);
+			}
+		}
+	}
+	else if (flow_policy == FLOW_HOTSET)
+	{
+		// the hot flows are the first nr_hot_flows ones
+		for (uint64_t j = 0; j < n; j++)
+		{
+			rng_block_t r = rng_philox(seed, RNG_STREAM_FLOW, first + j);
+			if (rng_u01(r.x0) < hot_traffic)
+			{
+				flows[j] = rng_bounded((uint32_t)r.x1, nr_hot_flows);
 			}
 			else
 			{
-				application_array[j].iterations = srv_iterations1;
+				flows[j] = nr_hot_flows + rng_bounded((uint32_t)r.x1, nr_flows - nr_hot_flows);
 			}
 		}
 	}
+	else
+	{
+		for (uint64_t j = 0; j < n; j++)
+		{
+			flows[j] = sample_onoff_flow(first + j);
+		}
+	}
+}
+
+// Parse the flow policy "roundrobin", "uniform", "zipf:SKEW", "hotset:TRAFFIC%:FLOWS%", or "onoff:ON_US:OFF_US" (-1 if invalid)
+static int parse_flow_policy(const char *spec)
+{
+	if (strcmp(spec, "roundrobin") == 0)
+	{
+		flow_policy = FLOW_ROUND_ROBIN;
+	}
+	else if (strcmp(spec, "uniform") == 0)
+	{
+		flow_policy = FLOW_UNIFORM;
+	}
+	else if (sscanf(spec, "zipf:%lf", &zipf_skew) == 1)
+	{
+		flow_policy = FLOW_ZIPF;
+		if (zipf_skew <= 0)
+		{
+			return -1;
+		}
+	}
+	else if (sscanf(spec, "hotset:%lf:%lf", &hot_traffic, &hot_flows) == 2)
+	{
+		flow_policy = FLOW_HOTSET;
+		if (hot_traffic < 0 || hot_traffic > 100 || hot_flows <= 0 || hot_flows >= 100)
+		{
+			return -1;
+		}
+		hot_traffic /= 100;
+		hot_flows /= 100;
+	}
+	else if (sscanf(spec, "onoff:%lu:%lu", &on_time_us, &off_time_us) == 2)
+	{
+		flow_policy = FLOW_ONOFF;
+		if (on_time_us == 0)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+// Prepare the flow policy once the number of flows is known
+static void create_flow_policy()
+{
+	if (flow_policy == FLOW_ZIPF)
+	{
+		// the flow i has the rank i + 1
+		double *weights = (double *)malloc(nr_flows * sizeof(double));
+		if (weights == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the Zipf weights.\n");
+		}
+		for (uint32_t i = 0; i < nr_flows; i++)
+		{
+			weights[i] = 1.0 / pow(i + 1, zipf_skew);
+		}
+
+		zipf_table = alias_create(NULL, weights, nr_flows);
+		free(weights);
+		if (zipf_table == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the Zipf alias table.\n");
+		}
+	}
+	else if (flow_policy == FLOW_HOTSET)
+	{
+		nr_hot_flows = (uint32_t)ceil(hot_flows * nr_flows);
+		if (nr_hot_flows == 0 || nr_hot_flows >= nr_flows)
+		{
+			rte_exit(EXIT_FAILURE, "The hot set needs at least one hot and one cold flow.\n");
+		}
+	}
+}
+
+// Allocate one latency histogram per phase and RX queue, plus the merged ones (constant memory regardless of the duration)
+void create_latency_histograms()
+{
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		latency_histograms[p] = histogram_create(histogram_digits);
+		if (latency_histograms[p] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the latency histograms.\n");
+		}
+
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			rx_results[q].histograms[p] = histogram_create(histogram_digits);
+			if (rx_results[q].histograms[p] == NULL)
+			{
+				rte_exit(EXIT_FAILURE, "Cannot alloc the latency histograms.\n");
+			}
+		}
+	}
+
+	// one more histogram per size class that the requests can fall in when the sizes vary
+	if (request_sizes.min == request_sizes.max && response_sizes.min == response_sizes.max)
+	{
+		return;
+	}
+	uint32_t last = size_class(request_sizes.max, response_sizes.max);
+	for (uint32_t c = size_class(request_sizes.min, response_sizes.min); c <= last; c++)
+	{
+		size_histograms[c] = histogram_create(histogram_digits);
+		if (size_histograms[c] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the latency histograms.\n");
+		}
+
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			rx_results[q].size_histograms[c] = histogram_create(histogram_digits);
+			if (rx_results[q].size_histograms[c] == NULL)
+			{
+				rte_exit(EXIT_FAILURE, "Cannot alloc the latency histograms.\n");
+			}
+		}
+	}
+}
+
+// Merge the histograms of all RX queues (once the RX lcores stopped recording)
+void merge_rx_results()
+{
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		histogram_reset(latency_histograms[p]);
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			histogram_merge(latency_histograms[p], rx_results[q].histograms[p]);
+		}
+	}
+
+	for (uint32_t c = 0; c < SIZE_CLASSES; c++)
+	{
+		if (size_histograms[c] == NULL)
+		{
+			continue;
+		}
+
+		histogram_reset(size_histograms[c]);
+		for (uint32_t q = 0; q < nr_rx_queues; q++)
+		{
+			histogram_merge(size_histograms[c], rx_results[q].size_histograms[c]);
+		}
+	}
+}
+
+// Allocate the queue of requests parked by each TX lcore while the windows of their flows are closed
+void create_deferred_queues()
+{
+	uint32_t nr_owned = (nr_flows + nr_tx_lcores - 1) / nr_tx_lcores;
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		deferred_queues[q] = deferred_create(nr_owned, DEFERRED_POOL_ELEMENTS, histogram_digits);
+		if (deferred_queues[q] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the deferred queues.\n");
+		}
+	}
+}
+
+// Open the binary output streamed by the writer lcore
+void create_binary_output()
+{
+	if (bin_output_file[0] == '\0')
+	{
+		return;
+	}
+
+	bin_writer = writer_open(bin_output_file, nr_rx_queues);
+	if (bin_writer == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot open the binary output file.\n");
+	}
+}
+
+// Write the header of the binary output with the parameters of the run
+void close_binary_output()
+{
+	writer_header_t header = {0};
+	header.ticks_per_us = TICKS_PER_US;
+	header.seed = seed;
+	header.distribution = distribution;
+	header.rate = rate;
+	header.duration = duration;
+	header.nr_flows = nr_flows;
+	header.frame_size = frame_size;
+	header.nr_tx_lcores = nr_tx_lcores;
+	header.srv_distribution = srv_distribution;
+	header.srv_iterations0 = srv_iterations0;
+	header.srv_iterations1 = srv_iterations1;
+	header.srv_mode = srv_mode;
+	header.tx_start_tsc = tx_start_tsc;
+	header.nr_phases = nr_phases;
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		header.phases_start_tsc[p] = phases[p].start_tsc;
+	}
+
+	if (writer_close(bin_writer, &header) != 0)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot write the binary output file.\n");
+	}
+	bin_writer = NULL;
+
+	printf("binary output = %s -- records = %lu -- dropped = %lu\n", bin_output_file, header.nr_records, header.nr_dropped);
+}
+
+// Allocate and create all nodes for incoming packets (per-packet capture only with an output file)
+void create_incoming_array()
+{
+	if (output_file[0] == '\0')
+	{
+		return;
+	}
+
+	// any RX queue may receive all responses (e.g., a single flow)
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
+	{
+		rx_results[q].incoming_capacity = nr_elements;
+		rx_results[q].incoming_array = (node_t *)rte_malloc(NULL, nr_elements * sizeof(node_t), 64);
+		if (rx_results[q].incoming_array == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot alloc the incoming array.\n");
+		}
+	}
+}
+
+// Allocate an array for all interarrival packets for rate specified.
+void create_interarrival_array()
+{
+
+	interarrival_array = (uint64_t *)rte_malloc(NULL, nr_elements * sizeof(uint64_t), 64);
+	if (interarrival_array == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the interarrival_gap array.\n");
+	}
+
+}
+
+// Allocate an array for all flow indentier to send to the server
+void create_flow_indexes_array()
+{
+
+	flow_indexes_array = (uint32_t *)rte_malloc(NULL, nr_elements * sizeof(uint32_t), 64);
+	if (flow_indexes_array == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the flow_indexes array.\n");
+	}
+}
+
+// Allocate the schedule of the TX lcore q for its n requests (one more, so a TX lcore without requests gets valid arrays)
+static void create_tx_schedule(uint32_t q, uint64_t n)
+{
+	schedule_chunk_t *chunk = &schedule_array_chunks[q];
+
+	chunk->nr_elements = n;
+	chunk->deadline = (uint64_t *)rte_malloc(NULL, (n + 1) * sizeof(uint64_t), 64);
+	chunk->flow_indexes = (uint32_t *)rte_malloc(NULL, (n + 1) * sizeof(uint32_t), 64);
+	chunk->application = (application_node_t *)rte_malloc(NULL, (n + 1) * sizeof(application_node_t), 64);
+	if (chunk->deadline == NULL || chunk->flow_indexes == NULL || chunk->application == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the schedule of the TX lcore %u.\n", q);
+	}
+}
+
+// Create the arrival schedule of the run (or of the current probe)
+void create_schedule()
+{
+	if (closed_loop_window > 0)
+	{
+		// create the rings to notify the TX lcores about completed requests
+		create_completion_rings();
+	}
+	else if (stream_schedule)
+	{
+		// create the chunk pool and rings to stream the schedule to the TX lcores (only once)
+		if (schedule_pool == NULL)
+		{
+			create_schedule_stream();
+		}
+	}
+	else
+	{
+		// create flow indexes array
+		create_flow_indexes_array();
+
+		// create interarrival array
+		create_interarrival_array();
+
+		// generate the schedule in parallel on all lcores and split it between the TX lcores
+		fill_schedule_arrays();
+	}
+}
+
+// Release the precomputed schedule arrays
+void free_schedule_arrays()
+{
+	rte_free(flow_indexes_array);
+	rte_free(interarrival_array);
+
+	flow_indexes_array = NULL;
+	interarrival_array = NULL;
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		schedule_chunk_t *chunk = &schedule_array_chunks[q];
+		rte_free(chunk->deadline);
+		rte_free(chunk->flow_indexes);
+		rte_free(chunk->application);
+		memset(chunk, 0, sizeof(schedule_chunk_t));
+	}
+}
+
+// Fill a contiguous range of the schedule arrays, counting the requests of each TX lcore and the time the range spans
+static int lcore_fill_schedule(void *arg)
+{
+	schedule_fill_job_t *job = (schedule_fill_job_t *)arg;
+
+	fill_interarrival(&interarrival_array[job->first], job->first, job->n);
+	fill_flow_indexes(&flow_indexes_array[job->first], job->first, job->n);
+
+	memset(job->counts, 0, nr_tx_lcores * sizeof(uint64_t));
+	job->offset = 0;
+	for (uint64_t i = job->first; i < job->first + job->n; i++)
+	{
+		job->counts[flow_indexes_array[i] % nr_tx_lcores]++;
+		job->offset += interarrival_array[i];
+	}
+
+	return 0;
+}
+
+// Move a contiguous range of the schedule to the TX lcores that own its flows, from the positions and send time of the range
+static int lcore_split_schedule(void *arg)
+{
+	schedule_fill_job_t *job = (schedule_fill_job_t *)arg;
+	uint64_t offset = job->offset;
+
+	for (uint64_t i = job->first; i < job->first + job->n; i++)
+	{
+		uint32_t q = flow_indexes_array[i] % nr_tx_lcores;
+		schedule_chunk_t *chunk = &schedule_array_chunks[q];
+		uint64_t k = job->counts[q]++;
+
+		offset += interarrival_array[i];
+		chunk->deadline[k] = offset;
+		chunk->flow_indexes[k] = flow_indexes_array[i];
+		fill_application(&chunk->application[k], i, 1);
+	}
+
+	return 0;
+}
+
+// Run one job per lcore, the main lcore taking the first one
+static void run_schedule_jobs(lcore_function_t *f, schedule_fill_job_t *jobs, uint32_t *idle_lcores, uint32_t nr_idle)
+{
+	for (uint32_t j = 0; j < nr_idle; j++)
+	{
+		rte_eal_remote_launch(f, &jobs[j + 1], idle_lcores[j]);
+	}
+
+	f(&jobs[0]);
+
+	for (uint32_t j = 0; j < nr_idle; j++)
+	{
+		rte_eal_wait_lcore(idle_lcores[j]);
+	}
+}
+
+// Fill the schedule arrays using all idle lcores and split them between the TX lcores, so each TX lcore only walks the
+// requests of its own flows (the result does not depend on the number of lcores)
+void fill_schedule_arrays()
+{
+	uint32_t nr_idle = 0;
+	uint32_t idle_lcores[RTE_MAX_LCORE];
+	schedule_fill_job_t jobs[RTE_MAX_LCORE];
+
+	// the RX lcores keep running between the probes of the saturation search
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH_WORKER(lcore_id)
+	{
+		if (rte_eal_get_lcore_state(lcore_id) == WAIT)
+		{
+			idle_lcores[nr_idle++] = lcore_id;
+		}
+	}
+	uint32_t nr_jobs = nr_idle + 1;
+
+	// the requests of each TX lcore in each range
+	uint64_t *counts = (uint64_t *)rte_malloc(NULL, nr_jobs * nr_tx_lcores * sizeof(uint64_t), 64);
+	if (counts == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot alloc the schedule counts.\n");
+	}
+
+	// split the schedule into contiguous ranges aligned to the chunk size
+	uint64_t per_job = RTE_ALIGN_CEIL((nr_elements + nr_jobs - 1) / nr_jobs, (uint64_t)SCHEDULE_CHUNK_ELEMENTS);
+	for (uint32_t j = 0; j < nr_jobs; j++)
+	{
+		jobs[j].first = RTE_MIN(j * per_job, nr_elements);
+		jobs[j].n = RTE_MIN(per_job, nr_elements - jobs[j].first);
+		jobs[j].counts = &counts[j * nr_tx_lcores];
+	}
+
+	run_schedule_jobs(lcore_fill_schedule, jobs, idle_lcores, nr_idle);
+
+	// each range starts where the previous ones end, in the schedule of each TX lcore and in time
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		uint64_t total = 0;
+		for (uint32_t j = 0; j < nr_jobs; j++)
+		{
+			uint64_t n = jobs[j].counts[q];
+			jobs[j].counts[q] = total;
+			total += n;
+		}
+		create_tx_schedule(q, total);
+	}
+	uint64_t offset = 0;
+	for (uint32_t j = 0; j < nr_jobs; j++)
+	{
+		uint64_t span = jobs[j].offset;
+		jobs[j].offset = offset;
+		offset += span;
+	}
+
+	run_schedule_jobs(lcore_split_schedule, jobs, idle_lcores, nr_idle);
+
+	// only the schedules of the TX lcores are kept
+	rte_free(counts);
+	rte_free(flow_indexes_array);
+	rte_free(interarrival_array);
+	flow_indexes_array = NULL;
+	interarrival_array = NULL;
+}
+
+// Point the chunk arrays to the storage that follows the chunk in the mempool object
+static void init_schedule_chunk(struct rte_mempool *mp, void *opaque, void *obj, unsigned idx)
+{
+	schedule_chunk_t *chunk = (schedule_chunk_t *)obj;
+
+	chunk->nr_elements = 0;
+	chunk->deadline = (uint64_t *)(chunk + 1);
+	chunk->application = (application_node_t *)(chunk->deadline + SCHEDULE_CHUNK_ELEMENTS);
+	chunk->flow_indexes = (uint32_t *)(chunk->application + SCHEDULE_CHUNK_ELEMENTS);
+}
+
+// Create the chunk pool and one ring per TX lcore for the streaming schedule (each TX lcore gets its own chunks)
+void create_schedule_stream()
+{
+	size_t chunk_size = sizeof(schedule_chunk_t) + SCHEDULE_CHUNK_ELEMENTS * (sizeof(uint64_t) + sizeof(application_node_t) + sizeof(uint32_t));
+	uint32_t nr_chunks = SCHEDULE_POOL_CHUNKS * nr_tx_lcores;
+
+	schedule_pool = rte_mempool_create("schedule_pool", nr_chunks, chunk_size, 0, 0, NULL, NULL, init_schedule_chunk, NULL, rte_socket_id(), 0);
+	if (schedule_pool == NULL)
+	{
+		rte_exit(EXIT_FAILURE, "Cannot create the schedule pool.\n");
+	}
+
+	// a ring can hold all chunks, so the producer only waits for the pool
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		char s[64];
+		snprintf(s, sizeof(s), "ring_schedule_%u", q);
+		schedule_rings[q] = rte_ring_create(s, rte_align32pow2(nr_chunks + 1), rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (schedule_rings[q] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot create the schedule ring %u.\n", q);
+		}
+	}
+}
+
+// Generate the next block of the schedule, starting at the request first, and hand each TX lcore a chunk with its requests
+void produce_schedule_chunk(uint64_t first, uint64_t n)
+{
+	static uint64_t offset;
+	schedule_chunk_t *chunks[RTE_MAX_LCORE] = {NULL};
+
+	// the send times count from the start of the schedule
+	if (first == 0)
+	{
+		offset = 0;
+	}
+
+	fill_interarrival(stream_interarrival, first, n);
+	fill_flow_indexes(stream_flow_indexes, first, n);
+
+	for (uint64_t j = 0; j < n; j++)
+	{
+		uint32_t q = stream_flow_indexes[j] % nr_tx_lcores;
+		schedule_chunk_t *chunk = chunks[q];
+
+		// wait for a chunk released by the TX lcores
+		if (chunk == NULL)
+		{
+			while (rte_mempool_get(schedule_pool, (void **)&chunk) != 0)
+			{
+				// the TX lcores stopped early and release no more chunks
+				if (quit_tx)
+				{
+					return;
+				}
+				rte_pause();
+			}
+			chunk->nr_elements = 0;
+			chunks[q] = chunk;
+		}
+
+		uint64_t k = chunk->nr_elements++;
+		offset += stream_interarrival[j];
+		chunk->deadline[k] = offset;
+		chunk->flow_indexes[k] = stream_flow_indexes[j];
+		fill_application(&chunk->application[k], first + j, 1);
+	}
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		while (chunks[q] != NULL && rte_ring_sp_enqueue(schedule_rings[q], chunks[q]) != 0)
+		{
+			rte_pause();
+		}
+	}
+}
+
+// Create one ring per TX lcore to carry the completed requests of its flows (closed-loop mode)
+void create_completion_rings()
+{
+	// every in-flight request of the owned flows may complete at once
+	uint32_t nr_slots = ((nr_flows + nr_tx_lcores - 1) / nr_tx_lcores) * closed_loop_window;
+
+	// several RX lcores may complete requests of the same TX lcore
+	unsigned flags = RING_F_SC_DEQ | (nr_rx_queues > 1 ? 0 : RING_F_SP_ENQ);
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		char s[64];
+		snprintf(s, sizeof(s), "ring_completion_%u", q);
+		completion_rings[q] = rte_ring_create_elem(s, sizeof(uint32_t), rte_align32pow2(nr_slots + 1), rte_socket_id(), flags);
+		if (completion_rings[q] == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot create the completion ring %u.\n", q);
+		}
+	}
+}
+
+// Release the previous chunk and return the next one for the TX lcore (NULL at the end of the schedule)
+schedule_chunk_t *next_schedule_chunk(uint32_t qid, schedule_chunk_t *prev)
+{
+	schedule_chunk_t *chunk;
+
+	if (!stream_schedule)
+	{
+		return prev == NULL ? &schedule_array_chunks[qid] : NULL;
+	}
+
+	// the chunk belongs to this TX lcore only, so it goes back to the producer right away
+	if (prev != NULL)
+	{
+		rte_mempool_put(schedule_pool, prev);
+	}
+
+	while (rte_ring_sc_dequeue(schedule_rings[qid], (void **)&chunk) != 0)
+	{
+		if (__atomic_load_n(&schedule_done, __ATOMIC_ACQUIRE))
+		{
+			// the producer may have published the last chunk right before finishing
+			return rte_ring_sc_dequeue(schedule_rings[qid], (void **)&chunk) == 0 ? chunk : NULL;
+		}
+		rte_pause();
+	}
+
+	return chunk;
+}
+
+// Clean up all allocate structures
+void clean_heap()
+{
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
+	{
+		rte_free(rx_results[q].incoming_array);
+		for (uint32_t p = 0; p < nr_phases; p++)
+		{
+			histogram_free(rx_results[q].histograms[p]);
+		}
+		for (uint32_t c = 0; c < SIZE_CLASSES; c++)
+		{
+			histogram_free(rx_results[q].size_histograms[c]);
+		}
+	}
+	free_schedule_arrays();
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		rte_ring_free(schedule_rings[q]);
+	}
+	rte_mempool_free(schedule_pool);
+	alias_free(interarrival_table);
+	alias_free(zipf_table);
+
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		rte_ring_free(completion_rings[q]);
+		deferred_free(deferred_queues[q]);
+	}
+
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		histogram_free(latency_histograms[p]);
+	}
+	for (uint32_t c = 0; c < SIZE_CLASSES; c++)
+	{
+		histogram_free(size_histograms[c]);
+	}
+	alias_free(request_sizes.table);
+	alias_free(response_sizes.table);
+	free_telemetry();
+}
+
+// Parse a size distribution "SIZE", "constant:SIZE", "bimodal:SIZE0:SIZE1:MODE", or "empirical:FILENAME" (-1 if invalid)
+static int parse_size_distribution(const char *spec, size_distribution_t *dist)
+{
+	char filename[MAXSTRLEN];
+
+	if (sscanf(spec, "bimodal:%u:%u:%lf", &dist->value0, &dist->value1, &dist->mode) == 3)
+	{
+		if (dist->mode < 0 || dist->mode > 1)
+		{
+			return -1;
+		}
+		dist->type = BIMODAL_VALUE;
+		dist->min = RTE_MIN(dist->value0, dist->value1);
+		dist->max = RTE_MAX(dist->value0, dist->value1);
+	}
+	else if (sscanf(spec, "empirical:%127s", filename) == 1)
+	{
+		dist->table = alias_load_file(filename);
+		if (dist->table == NULL)
+		{
+			return -1;
+		}
+		dist->type = EMPIRICAL_VALUE;
+		dist->min = UINT32_MAX;
+		dist->max = 0;
+		for (uint32_t i = 0; i < dist->table->nr_entries; i++)
+		{
+			dist->table->values[i] = floor(dist->table->values[i]);
+			dist->min = RTE_MIN(dist->min, (uint32_t)dist->table->values[i]);
+			dist->max = RTE_MAX(dist->max, (uint32_t)dist->table->values[i]);
+		}
+	}
+	else if (sscanf(spec, "constant:%u", &dist->value0) == 1 || sscanf(spec, "%u", &dist->value0) == 1)
+	{
+		dist->type = CONSTANT_VALUE;
+		dist->min = dist->value0;
+		dist->max = dist->value0;
+	}
+	else
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+// Set the request and response size distributions (the request size of -s and echoed responses without -q and -Q)
+static void create_size_distributions()
+{
+	uint32_t headers = sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr);
+
+	if (request_sizes_spec[0] != '\0')
+	{
+		if (parse_size_distribution(request_sizes_spec, &request_sizes) != 0)
+		{
+			rte_exit(EXIT_FAILURE, "Invalid request size distribution.\n");
+		}
+		if (request_sizes.max + headers > MAX_PKTSIZE)
+		{
+			rte_exit(EXIT_FAILURE, "The request sizes must be up to %u bytes.\n", MAX_PKTSIZE - headers);
+		}
+
+		// the largest request sets up the port (segmentation) and the window check
+		tcp_payload_size = request_sizes.max;
+		frame_size = tcp_payload_size + headers;
+	}
+	else
+	{
+		request_sizes.value0 = tcp_payload_size;
+		request_sizes.min = tcp_payload_size;
+		request_sizes.max = tcp_payload_size;
+	}
+
+	if (response_sizes_spec[0] != '\0')
+	{
+		if (parse_size_distribution(response_sizes_spec, &response_sizes) != 0)
+		{
+			rte_exit(EXIT_FAILURE, "Invalid response size distribution.\n");
+		}
+	}
+	else
+	{
+		response_sizes.min = request_sizes.min;
+		response_sizes.max = request_sizes.max;
+	}
+	if (response_sizes.max > RESPONSE_SIZE_MASK)
+	{
+		rte_exit(EXIT_FAILURE, "The response sizes must be up to %d bytes.\n", RESPONSE_SIZE_MASK);
+	}
+
+	// a retransmission starts at the oldest unacked SEQ, so the size of the request there must be known
+	if (rto_us > 0 && request_sizes.min != request_sizes.max)
+	{
+		rte_exit(EXIT_FAILURE, "The retransmissions (-O) require a constant request size.\n");
+	}
+}
+
+// Pick the optional fields of the compact header and check that the smallest request and response carry the header
+static void create_wire_header()
+{
+	uint32_t headers = sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr);
+	uint32_t min_payload = MIN_PKTSIZE - headers;
+
+	if (header_layout == HEADER_COMPACT)
+	{
+		compact_flags = 0;
+		if (response_sizes.type != ECHO_VALUE || request_sizes.min != request_sizes.max)
+		{
+			compact_flags |= COMPACT_SIZE;
+		}
+		if (srv_iterations0 > 0 || srv_iterations1 > 0)
+		{
+			compact_flags |= COMPACT_WORK;
+		}
+		header_size = compact_header_size(compact_flags);
+		min_payload = header_size;
+	}
+
+	if (request_sizes.min < min_payload)
+	{
+		rte_exit(EXIT_FAILURE, "The minimum packet size is %u.\n", min_payload + headers);
+	}
+	if (response_sizes.min < response_header_size())
+	{
+		rte_exit(EXIT_FAILURE, "The responses must carry at least %u bytes.\n", response_header_size());
+	}
+}
+
+// Convert the name of a client distribution into its value (-1 if unknown)
+static int parse_distribution(const char *name)
+{
+	if (strcmp(name, "uniform") == 0)
+	{
+		return UNIFORM_VALUE;
+	}
+	else if (strcmp(name, "exponential") == 0)
+	{
+		return EXPONENTIAL_VALUE;
+	}
+	else if (strcmp(name, "lognormal") == 0)
+	{
+		return LOGNORMAL_VALUE;
+	}
+	else if (strcmp(name, "pareto") == 0)
+	{
+		return PARETO_VALUE;
+	}
+	else if (strcmp(name, "empirical") == 0)
+	{
+		// loaded from the -E file
+		return EMPIRICAL_VALUE;
+	}
+
+	return -1;
+}
+
+// Check whether any phase uses the distribution
+static int uses_distribution(int value)
+{
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		if (phases[p].distribution == value)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Replace the phases by a single one at the probe rate (saturation search)
+void set_probe_phase(double probe_rate)
+{
+	nr_phases = 1;
+	phases[0].rate_start = probe_rate;
+	phases[0].rate_end = probe_rate;
+	phases[0].duration = probe_duration;
+	phases[0].distribution = distribution;
+	phases[0].first = 0;
+	phases[0].nr_elements = (uint64_t)(probe_rate * probe_duration);
+	phases[0].start_tsc = UINT64_MAX;
+	nr_elements = phases[0].nr_elements;
 }
 
-// Allocate and create all nodes for incoming packets
-void create_incoming_array()
+// Set when each phase starts from the TX start and the durations of the phases before it (before any TX lcore runs)
+void set_phases_start(uint64_t start_tsc)
 {
-	incoming_array = (node_t *)rte_malloc(NULL, rate * duration * sizeof(node_t), 64);
-	if (incoming_array == NULL)
+	for (uint32_t p = 0; p < nr_phases; p++)
 	{
-		rte_exit(EXIT_FAILURE, "Cannot alloc the incoming array.\n");
+		phases[p].start_tsc = start_tsc;
+		start_tsc += phases[p].duration * 1000000 * TICKS_PER_US;
 	}
 }
 
-// Allocate and create an array for all interarrival packets for rate specified.
-void create_interarrival_array()
+// Build the phases of the run from "rate[-rate_end]:duration[:distribution],..." (or from -r, -t, and -d)
+static void create_phases(char *spec)
 {
-	uint64_t nr_elements = rate * duration;
+	nr_phases = 0;
 
-	interarrival_array = (uint32_t *)rte_malloc(NULL, nr_elements * sizeof(uint32_t), 0);
-	if (interarrival_array == NULL)
+	if (spec[0] == '\0')
 	{
-		rte_exit(EXIT_FAILURE, "Cannot alloc the interarrival_gap array.\n");
+		phases[0].rate_start = rate;
+		phases[0].rate_end = rate;
+		phases[0].duration = duration;
+		phases[0].distribution = distribution;
+		nr_phases = 1;
 	}
 
-	if (distribution == UNIFORM_VALUE)
-	{
-		// Uniform
-		double mean = (1.0 / rate) * 1000000.0;
-		for (uint64_t j = 0; j < nr_elements; j++)
-		{
-			interarrival_array[j] = mean * TICKS_PER_US;
-		}
-	}
-	else if (distribution == EXPONENTIAL_VALUE)
-	{
-		// Exponential
-		double lambda = 1.0 / (1000000.0 / rate);
-		for (uint64_t j = 0; j < nr_elements; j++)
-		{
-			interarrival_array[j] = sample_exponential(lambda) * TICKS_PER_US;
-		}
-	}
-	else if (distribution == LOGNORMAL_VALUE)
+	char *saveptr;
+	for (char *tok = strtok_r(spec, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr))
 	{
-		// Log-normal
-		double mean = (1.0 / rate) * 1000000.0;
-		double sigma = sqrt(2 * (log(mean) - log(mean / 2)));
-		double u = log(mean) - (sigma * sigma) / 2;
-		for (uint64_t j = 0; j < nr_elements; j++)
+		if (nr_phases == MAX_PHASES)
 		{
-			interarrival_array[j] = sample_lognormal(u, sigma) * TICKS_PER_US;
+			rte_exit(EXIT_FAILURE, "The maximum number of phases is %d.\n", MAX_PHASES);
 		}
-	}
-	else if (distribution == PARETO_VALUE)
-	{
-		// Pareto
-		double mean = (1.0 / rate) * 1000000.0;
-		double alpha = 1.0 + mean / (mean - 1.0);
-		double xm = mean * (alpha - 1) / (alpha);
-		for (uint64_t j = 0; j < nr_elements; j++)
+
+		phase_t *phase = &phases[nr_phases++];
+		char *end;
+
+		// rate or linear ramp
+		phase->rate_start = strtod(tok, &end);
+		phase->rate_end = (*end == '-') ? strtod(end + 1, &end) : phase->rate_start;
+		if (*end != ':')
 		{
-			interarrival_array[j] = sample_pareto(alpha, xm) * TICKS_PER_US;
+			rte_exit(EXIT_FAILURE, "Invalid phase %s.\n", tok);
 		}
-	}
-	else
-	{
-		exit(-1);
-	}
-}
 
-// Allocate and create an array for all flow indentier to send to the server
-void create_flow_indexes_array()
-{
-	uint64_t nr_elements = rate * duration;
+		// duration
+		phase->duration = strtoul(end + 1, &end, 10);
 
-	flow_indexes_array = (uint16_t *)rte_malloc(NULL, nr_elements * sizeof(uint16_t), 64);
-	if (flow_indexes_array == NULL)
-	{
-		rte_exit(EXIT_FAILURE, "Cannot alloc the flow_indexes array.\n");
-	}
+		// distribution
+		phase->distribution = (*end == ':') ? parse_distribution(end + 1) : distribution;
 
-	uint32_t last = 0;
-	for (uint64_t i = 0; i < nr_flows; i++)
-	{
-		flow_indexes_array[last++] = i;
+		if (phase->rate_start <= 0 || phase->rate_end <= 0 || phase->duration == 0 || phase->distribution < 0)
+		{
+			rte_exit(EXIT_FAILURE, "Invalid phase %s.\n", tok);
+		}
 	}
 
-	for (uint64_t i = last; i < nr_elements; i++)
+	// each phase owns a contiguous range of the schedule
+	uint64_t first = 0;
+	duration = 0;
+	for (uint32_t p = 0; p < nr_phases; p++)
 	{
-		flow_indexes_array[i] = i % nr_flows;
+		// no response is counted until the start of the run sets the phase boundaries
+		phases[p].start_tsc = UINT64_MAX;
+		phases[p].first = first;
+		phases[p].nr_elements = (uint64_t)(((phases[p].rate_start + phases[p].rate_end) / 2) * phases[p].duration);
+		first += phases[p].nr_elements;
+		duration += phases[p].duration;
 	}
-}
-
-// Clean up all allocate structures
-void clean_heap()
-{
-	rte_free(incoming_array);
-	rte_free(flow_indexes_array);
-	rte_free(interarrival_array);
-	rte_free(application_array);
+	nr_elements = first;
 }
 
 // Usage message
 static void usage(const char *prgname)
 {
 	printf("%s [EAL options] -- \n"
-				 "  -d DISTRIBUTION: <uniform|exponential|lognormal|pareto>\n"
+				 "  -d DISTRIBUTION: <uniform|exponential|lognormal|pareto|empirical>\n"
+				 "  -E FILENAME: empirical interarrival distribution (\"value_us weight\" per line, optional \"cdf\" header)\n"
 				 "  -r RATE: rate in pps\n"
 				 "  -f FLOWS: number of flows\n"
-				 "  -s SIZE: frame size in bytes\n"
+				 "  -u POLICY: <roundrobin|uniform|zipf:SKEW|hotset:TRAFFIC%%:FLOWS%%|onoff:ON_US:OFF_US> flow of each request (default roundrobin)\n"
+				 "  -s SIZE: frame size in bytes (up to 65549, requests longer than the MSS are segmented)\n"
+				 "  -y SIZE: TCP payload size of each response in bytes (default: the payload size of the request)\n"
+				 "  -q SIZES: <SIZE|bimodal:SIZE0:SIZE1:MODE|empirical:FILENAME> TCP payload size of each request in bytes (overrides -s)\n"
+				 "  -Q SIZES: <SIZE|bimodal:SIZE0:SIZE1:MODE|empirical:FILENAME> TCP payload size of each response in bytes (overrides -y)\n"
+				 "  -H LAYOUT: <legacy|compact> layout of the request header (default legacy, compact allows 64-byte wire frames with -s 60)\n"
+				 "  -Z: send the payload of the requests from a shared read-only buffer (zero copy)\n"
+				 "  -M MSS: TCP maximum segment size of the requests (default 1460)\n"
 				 "  -t TIME: time in seconds to send packets\n"
+				 "  -P PHASES: run back-to-back phases \"rate[-rate_end]:time[:distribution],...\" (overrides -r, -t, and -d)\n"
+				 "  -L PCT:LATENCY: search the highest rate up to RATE whose PCT percentile is below LATENCY us (probes of TIME s)\n"
+				 "  -R RX_QUEUES: use RX_QUEUES RX queues, each one polled by an lcore that processes the responses inline (default: one queue and an RX ring)\n"
+				 "  -F CLASSIFIER: <rte_flow|async|software> how responses are mapped to flows (default rte_flow, software if the NIC rejects the rules)\n"
+				 "  -W WINDOW: number of TCP handshakes in flight at startup (default 1024)\n"
+				 "  -O RTO: retransmit the oldest unacked request of a flow after RTO us without an ACK (default 0, disabled)\n"
+				 "  -T TX_CORES: number of TX lcores, each one with its own TX queue (default 1)\n"
+				 "  -K WINDOW: closed-loop mode with at most WINDOW requests in flight per flow (default 0, open-loop)\n"
+				 "  -z THINK: mean think time in us (exponential) before each closed-loop request (default 0)\n"
+				 "  -S: stream the schedule from a producer lcore instead of precomputing it\n"
+				 "  -w WINDOW: send all packets whose deadlines fall within WINDOW ns in one burst (default 0)\n"
 				 "  -e SEED: seed\n"
 				 "  -D DISTRIBUTION: <constant|exponential|bimodal> on the server\n"
 				 "  -i INSTRUCTIONS: number of instructions on the server\n"
 				 "  -j INSTRUCTIONS: number of instructions on the server\n"
 				 "  -m MODE: mode for Bimodal distribution\n"
 				 "  -c FILENAME: name of the configuration file\n"
-				 "  -o FILENAME: name of the output file\n",
+				 "  -o FILENAME: name of the output file with the latency of each packet (optional)\n"
+				 "  -b FILENAME: stream the latency of each packet to a binary file from a writer lcore (optional)\n"
+				 "  -v: print the live counters and percentiles to stderr once per second\n"
+				 "  -p DIGITS: significant digits of the latency histograms (default 3)\n",
 				 prgname);
 }
 
@@ -220,36 +1287,31 @@ int app_parse_args(int argc, char **argv)
 	char *prgname = argv[0];
 
 	argvopt = argv;
-	while ((opt = getopt(argc, argvopt, "d:r:f:s:t:c:o:e:D:i:j:m:")) != EOF)
+	while ((opt = getopt(argc, argvopt, "d:E:r:f:u:s:y:q:Q:H:ZM:t:P:L:R:F:W:O:T:K:z:Sw:c:o:b:p:ve:D:i:j:m:")) != EOF)
 	{
 		switch (opt)
 		{
 		// distribution on the client
 		case 'd':
-			if (strcmp(optarg, "uniform") == 0)
-			{
-				// Uniform distribution
-				distribution = UNIFORM_VALUE;
-			}
-			else if (strcmp(optarg, "exponential") == 0)
-			{
-				// Exponential distribution
-				distribution = EXPONENTIAL_VALUE;
-			}
-			else if (strcmp(optarg, "lognormal") == 0)
-			{
-				// Lognormal distribution
-				distribution = LOGNORMAL_VALUE;
-			}
-			else if (strcmp(optarg, "pareto") == 0)
+			distribution = parse_distribution(optarg);
+			if (distribution < 0)
 			{
-				// Pareto distribution
-				distribution = PARETO_VALUE;
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
 			}
-			else
+			break;
+
+		// empirical distribution file on the client
+		case 'E':
+			snprintf(empirical_file, sizeof(empirical_file), "%s", optarg);
+			break;
+
+		// flow of each request
+		case 'u':
+			if (parse_flow_policy(optarg) < 0)
 			{
 				usage(prgname);
-				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+				rte_exit(EXIT_FAILURE, "Invalid flow policy.\n");
 			}
 			break;
 
@@ -301,15 +1363,23 @@ int app_parse_args(int argc, char **argv)
 		// flows
 		case 'f':
 			nr_flows = process_int_arg(optarg);
-			assert(nr_flows > 0);
+			if (nr_flows == 0 || nr_flows >= CLASSIFIER_MISS)
+			{
+				rte_exit(EXIT_FAILURE, "The number of flows must be between 1 and %u.\n", CLASSIFIER_MISS - 1);
+			}
 			break;
 
 		// frame size (bytes)
 		case 's':
 			frame_size = process_int_arg(optarg);
-			if (frame_size < MIN_PKTSIZE)
+			if (frame_size > MAX_PKTSIZE)
+			{
+				rte_exit(EXIT_FAILURE, "The maximum packet size is %d.\n", MAX_PKTSIZE);
+			}
+			// the smallest header of all layouts (the minimum of the chosen one is checked once all options are parsed)
+			if (frame_size < sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + COMPACT_BASE_SIZE)
 			{
-				rte_exit(EXIT_FAILURE, "The minimum packet size is %d.\n", MIN_PKTSIZE);
+				rte_exit(EXIT_FAILURE, "The minimum packet size is %lu.\n", sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) + COMPACT_BASE_SIZE);
 			}
 			tcp_payload_size = (frame_size - sizeof(struct rte_ether_hdr) - sizeof(struct rte_ipv4_hdr) - sizeof(struct rte_tcp_hdr));
 			printf("payload=%d\n", tcp_payload_size);
@@ -321,6 +1391,131 @@ int app_parse_args(int argc, char **argv)
 			assert(duration > 0);
 			break;
 
+		// phases
+		case 'P':
+			snprintf(phases_spec, sizeof(phases_spec), "%s", optarg);
+			break;
+
+		// latency SLO for the saturation search
+		case 'L':
+			if (sscanf(optarg, "%lf:%lu", &slo_percentile, &slo_latency) != 2 || slo_percentile <= 0 || slo_percentile >= 100)
+			{
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+			}
+			break;
+
+		// number of RX queues (run-to-completion RX lcores)
+		case 'R':
+			nr_rx_queues = process_int_arg(optarg);
+			assert(nr_rx_queues > 0);
+			rx_inline = 1;
+			break;
+
+		// flow classifier
+		case 'F':
+			if (strcmp(optarg, "rte_flow") == 0)
+			{
+				flow_classifier = CLASSIFIER_RTE_FLOW;
+			}
+			else if (strcmp(optarg, "software") == 0)
+			{
+				flow_classifier = CLASSIFIER_SOFTWARE;
+			}
+			else if (strcmp(optarg, "async") == 0)
+			{
+				flow_classifier = CLASSIFIER_ASYNC;
+			}
+			else
+			{
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+			}
+			break;
+
+		// handshake window
+		case 'W':
+			handshake_window = process_int_arg(optarg);
+			assert(handshake_window > 0);
+			break;
+
+		// retransmission timeout (us)
+		case 'O':
+			rto_us = process_int_arg(optarg);
+			break;
+
+		// TCP payload size of the responses (B)
+		case 'y':
+			snprintf(response_sizes_spec, sizeof(response_sizes_spec), "constant:%s", optarg);
+			break;
+
+		// request size distribution (B)
+		case 'q':
+			snprintf(request_sizes_spec, sizeof(request_sizes_spec), "%s", optarg);
+			break;
+
+		// response size distribution (B)
+		case 'Q':
+			snprintf(response_sizes_spec, sizeof(response_sizes_spec), "%s", optarg);
+			break;
+
+		// zero-copy payloads
+		case 'Z':
+			zero_copy = 1;
+			break;
+
+		// layout of the request header
+		case 'H':
+			if (strcmp(optarg, "legacy") == 0)
+			{
+				header_layout = HEADER_LEGACY;
+			}
+			else if (strcmp(optarg, "compact") == 0)
+			{
+				header_layout = HEADER_COMPACT;
+			}
+			else
+			{
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid header layout.\n");
+			}
+			break;
+
+		// TCP maximum segment size of the requests
+		case 'M':
+			tcp_mss = process_int_arg(optarg);
+			if (tcp_mss < MIN_MSS || tcp_mss > MAX_MSS)
+			{
+				rte_exit(EXIT_FAILURE, "The MSS must be between %d and %d.\n", MIN_MSS, MAX_MSS);
+			}
+			break;
+
+		// number of TX lcores
+		case 'T':
+			nr_tx_lcores = process_int_arg(optarg);
+			assert(nr_tx_lcores > 0);
+			break;
+
+		// closed-loop window
+		case 'K':
+			closed_loop_window = process_int_arg(optarg);
+			break;
+
+		// closed-loop think time (us)
+		case 'z':
+			think_time = process_double_arg(optarg);
+			break;
+
+		// streaming schedule
+		case 'S':
+			stream_schedule = 1;
+			break;
+
+		// TX batching window (ns)
+		case 'w':
+			tx_batch_window = process_int_arg(optarg);
+			break;
+
 		// seed
 		case 'e':
 			seed = process_int_arg(optarg);
@@ -336,6 +1531,25 @@ int app_parse_args(int argc, char **argv)
 			strcpy(output_file, optarg);
 			break;
 
+		// binary output
+		case 'b':
+			snprintf(bin_output_file, sizeof(bin_output_file), "%s", optarg);
+			break;
+
+		// live stats line
+		case 'v':
+			live_stats = 1;
+			break;
+
+		// precision of the latency histograms
+		case 'p':
+			histogram_digits = process_int_arg(optarg);
+			if (histogram_digits < HISTOGRAM_MIN_DIGITS || histogram_digits > HISTOGRAM_MAX_DIGITS)
+			{
+				rte_exit(EXIT_FAILURE, "The histogram precision must be between %d and %d digits.\n", HISTOGRAM_MIN_DIGITS, HISTOGRAM_MAX_DIGITS);
+			}
+			break;
+
 		default:
 			usage(prgname);
 			rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
@@ -347,6 +1561,57 @@ int app_parse_args(int argc, char **argv)
 		argv[optind - 1] = prgname;
 	}
 
+	// build the phases (a single one from -r, -t, and -d without -P)
+	probe_duration = duration;
+	create_phases(phases_spec);
+
+	// the saturation search runs its own probes
+	if (slo_percentile > 0 && (nr_phases > 1 || closed_loop_window > 0))
+	{
+		rte_exit(EXIT_FAILURE, "The saturation search does not support -P or -K.\n");
+	}
+	if (slo_percentile > 0 && bin_output_file[0] != '\0')
+	{
+		rte_exit(EXIT_FAILURE, "The saturation search does not support -b.\n");
+	}
+
+	// load the empirical distribution and normalize it (each phase rescales it to its rate)
+	if (uses_distribution(EMPIRICAL_VALUE))
+	{
+		if (empirical_file[0] == '\0')
+		{
+			usage(prgname);
+			rte_exit(EXIT_FAILURE, "The empirical distribution requires -E.\n");
+		}
+		interarrival_table = alias_load_file(empirical_file);
+
+		// the gaps are rescaled to the mean of the rate, so they cannot all be zero
+		double mean = alias_mean(interarrival_table);
+		if (mean <= 0)
+		{
+			rte_exit(EXIT_FAILURE, "The mean of the distribution file %s must be positive.\n", empirical_file);
+		}
+		alias_scale(interarrival_table, 1.0 / mean);
+	}
+
+	// the echo server answers each request with its own payload unless told otherwise
+	create_size_distributions();
+	create_wire_header();
+
+	// the closed-loop mode does not use an arrival schedule
+	if (closed_loop_window > 0)
+	{
+		stream_schedule = 0;
+		if (flow_policy != FLOW_ROUND_ROBIN)
+		{
+			rte_exit(EXIT_FAILURE, "The closed-loop mode does not support -u.\n");
+		}
+	}
+	create_flow_policy();
+
+	// main + RX ring + RX + all TX lcores (+ schedule producer)
+	min_lcores = 1 + (rx_inline ? nr_rx_queues : 2) + nr_tx_lcores + stream_schedule + (bin_output_file[0] != '\0');
+
 	ret = optind - 1;
 	optind = 1;
 
@@ -358,7 +1623,23 @@ void wait_timeout()
 {
 	uint32_t remaining_in_s = 5;
 	fprintf(stderr, "in wait_timeout\n");
-	rte_delay_us_sleep((duration + remaining_in_s) * 1000000);
+	for (uint64_t s = 0; s < duration + remaining_in_s; s++)
+	{
+		rte_delay_us_sleep(1000000);
+
+		// print the live counters once per second
+		if (live_stats)
+		{
+			print_live_stats();
+		}
+
+		// the writer lcore could not write the binary output, so the run stops early
+		if (bin_writer && writer_failed(bin_writer))
+		{
+			fprintf(stderr, "stopping the run early\n");
+			break;
+		}
+	}
 	fprintf(stderr, "finished sleeping\n");
 	// set quit flag for all internal cores
 	quit_rx = 1;
@@ -375,14 +1656,200 @@ int cmp_func(const void *a, const void *b)
 	return (da - db) > ((fabs(da) < fabs(db) ? fabs(db) : fabs(da)) * EPSILON);
 }
 
+// Number of responses counted in all phases
+static uint64_t nr_received()
+{
+	uint64_t n = 0;
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		n += latency_histograms[p]->total;
+	}
+
+	return n;
+}
+
+// Print the latency percentiles of each phase
+static void print_phases_stats()
+{
+	printf("\nphase\trate\tduration\tscheduled\treceived\tthroughput\t50p\t99p\t99.9p\t99.99p\tmax\n");
+	for (uint32_t p = 0; p < nr_phases; p++)
+	{
+		histogram_t *h = latency_histograms[p];
+
+		printf("%u\t%.0f-%.0f\t%lu\t%lu\t%lu\t%.2f\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+					 p, phases[p].rate_start, phases[p].rate_end, phases[p].duration,
+					 phases[p].nr_elements, h->total, (double)h->total / phases[p].duration,
+					 histogram_percentile(h, 50), histogram_percentile(h, 99),
+					 histogram_percentile(h, 99.9), histogram_percentile(h, 99.99), h->total ? h->max : 0);
+	}
+}
+
+// Print the latency percentiles of each size class (only when the sizes vary)
+static void print_size_stats()
+{
+	if (request_sizes.min == request_sizes.max && response_sizes.min == response_sizes.max)
+	{
+		return;
+	}
+
+	printf("\nsize_class\tbytes\treceived\t50p\t99p\t99.9p\t99.99p\tmax\n");
+	for (uint32_t c = 0; c < SIZE_CLASSES; c++)
+	{
+		histogram_t *h = size_histograms[c];
+		if (h == NULL || h->total == 0)
+		{
+			continue;
+		}
+
+		printf("%u\t%lu-%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\n",
+					 c, 1UL << c, (2UL << c) - 1, h->total,
+					 histogram_percentile(h, 50), histogram_percentile(h, 99),
+					 histogram_percentile(h, 99.9), histogram_percentile(h, 99.99), h->max);
+	}
+}
+
+// Compute the latency of the probe that just finished (missing responses count as infinitely slow for the SLO)
+void evaluate_probe(probe_result_t *result, double probe_rate)
+{
+	merge_rx_results();
+	histogram_t *h = latency_histograms[0];
+
+	result->rate = probe_rate;
+	result->scheduled = nr_elements;
+	result->received = h->total;
+	result->never_sent = nr_never_sent;
+	result->p50 = histogram_percentile(h, 50);
+	result->p99 = histogram_percentile(h, 99);
+	result->p999 = histogram_percentile(h, 99.9);
+
+	// rank over all scheduled requests, so lost ones push the percentile up
+	uint64_t slo_rank = (uint64_t)ceil((slo_percentile / 100.0) * nr_elements);
+	result->slo_value = histogram_value_at_rank(h, slo_rank > 0 ? slo_rank : 1);
+	result->pass = result->slo_value <= slo_latency * 1000;
+
+	printf("probe rate = %.0f -- scheduled = %lu -- received = %lu -- never_sent = %lu -- %.2fp = %ld ns -- %s\n",
+				 result->rate, result->scheduled, result->received, result->never_sent, slo_percentile,
+				 result->slo_value == UINT64_MAX ? -1 : (int64_t)result->slo_value, result->pass ? "pass" : "fail");
+}
+
+// Print the latency curve of the probes and the maximum sustainable throughput
+void print_search_output(probe_result_t *results, uint32_t nr_probes, double max_rate)
+{
+	// open the file (optional)
+	FILE *fp = NULL;
+	if (output_file[0] != '\0')
+	{
+		fp = fopen(output_file, "w");
+		if (fp == NULL)
+		{
+			rte_exit(EXIT_FAILURE, "Cannot open the output file.\n");
+		}
+	}
+
+	printf("\nrate\tscheduled\treceived\tnever_sent\t50p\t99p\t99.9p\tslo\tpass\n");
+	if (fp)
+	{
+		fprintf(fp, "rate\tscheduled\treceived\tnever_sent\t50p\t99p\t99.9p\tslo\tpass\n");
+	}
+	for (uint32_t p = 0; p < nr_probes; p++)
+	{
+		probe_result_t *r = &results[p];
+		int64_t slo_value = r->slo_value == UINT64_MAX ? -1 : (int64_t)r->slo_value;
+
+		printf("%.0f\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%ld\t%d\n",
+					 r->rate, r->scheduled, r->received, r->never_sent, r->p50, r->p99, r->p999, slo_value, r->pass);
+		if (fp)
+		{
+			fprintf(fp, "%.0f\t%lu\t%lu\t%lu\t%lu\t%lu\t%lu\t%ld\t%d\n",
+							r->rate, r->scheduled, r->received, r->never_sent, r->p50, r->p99, r->p999, slo_value, r->pass);
+		}
+	}
+
+	printf("\nmax_sustainable_rate = %.0f (%.2fp < %lu us)\n", max_rate, slo_percentile, slo_latency);
+
+	// close the file
+	if (fp)
+	{
+		fclose(fp);
+	}
+}
+
 // Print stats into output file
 void print_stats_output()
 {
+	merge_rx_results();
+
 	uint64_t total_never_sent = nr_never_sent;
+	uint64_t total_received = nr_received();
+
+	// requests sent again, their responses, and responses the server sent but never arrived
+	uint64_t total_retransmitted = 0;
+	uint64_t total_retransmitted_received = 0;
+	uint64_t total_lost = 0;
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH(lcore_id)
+	{
+		total_retransmitted += lcore_counters[lcore_id].retransmitted;
+	}
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
+	{
+		total_retransmitted_received += rx_results[q].retransmitted;
+		total_lost += rx_results[q].lost;
+	}
+
+	if (closed_loop_window == 0 && (total_received + total_retransmitted_received + total_never_sent) != nr_elements)
+	{
+		printf("ERROR: received %ld (+ %ld retransmitted) and %ld never sent\n", total_received, total_retransmitted_received, total_never_sent);
+	}
+
+	printf("\nreceived = %ld -- never_sent = %ld\n", total_received, total_never_sent);
+	printf("retransmitted = %lu -- retransmitted_received = %lu -- lost_responses = %lu\n", total_retransmitted, total_retransmitted_received, total_lost);
+
+	// time spent by requests parked behind a closed receive window (not part of their latency)
+	histogram_t *waited = histogram_create(histogram_digits);
+	for (uint32_t q = 0; q < nr_tx_lcores; q++)
+	{
+		histogram_merge(waited, deferred_queues[q]->waited);
+	}
+	printf("deferred = %lu -- deferred_50p = %lu -- deferred_99p = %lu -- deferred_max = %lu ns\n",
+				 waited->total, histogram_percentile(waited, 50), histogram_percentile(waited, 99), waited->total ? waited->max : 0);
+	histogram_free(waited);
+
+	// print the throughput at fixed concurrency
+	if (closed_loop_window > 0)
+	{
+		printf("closed_loop_window = %u -- think_time = %.2f us -- throughput = %.2f rps\n",
+					 closed_loop_window, think_time, (double)total_received / duration);
+	}
+
+	// print the pacing error introduced by the TX batching window
+	if (tx_batch_window > 0)
+	{
+		tx_batch_stats_t total = {0};
+		for (uint32_t q = 0; q < nr_tx_lcores; q++)
+		{
+			total.nr_bursts += tx_batch_stats[q].nr_bursts;
+			total.nr_pkts += tx_batch_stats[q].nr_pkts;
+			total.early_ticks_sum += tx_batch_stats[q].early_ticks_sum;
+			total.early_ticks_max = RTE_MAX(total.early_ticks_max, tx_batch_stats[q].early_ticks_max);
+		}
+
+		double ticks_per_ns = (double)TICKS_PER_US / 1000;
+		printf("tx_window = %lu ns -- bursts = %lu -- avg_burst = %.2f -- avg_pacing_error = %.2f ns -- max_pacing_error = %.2f ns\n",
+					 tx_batch_window, total.nr_bursts,
+					 total.nr_bursts ? (double)total.nr_pkts / total.nr_bursts : 0.0,
+					 total.nr_pkts ? (total.early_ticks_sum / ticks_per_ns) / total.nr_pkts : 0.0,
+					 total.early_ticks_max / ticks_per_ns);
+	}
 
-	if ((incoming_idx + total_never_sent) != rate * duration)
+	// print the latency percentiles of each phase
+	print_phases_stats();
+	print_size_stats();
+
+	// per-packet capture is opt-in
+	if (output_file[0] == '\0')
 	{
-		printf("ERROR: received %d and %ld never sent\n", incoming_idx, total_never_sent);
+		return;
 	}
 
 	// open the file
@@ -392,17 +1859,27 @@ void print_stats_output()
 		rte_exit(EXIT_FAILURE, "Cannot open the output file.\n");
 	}
 
-	printf("\nincoming_idx = %d -- never_sent = %ld\n", incoming_idx, total_never_sent);
-
-	// print the RTT latency in (ns)
+	// print the RTT latency in (ns), followed by the phase when there are more than one (RX queue by RX queue)
 	node_t *cur;
-	for (uint64_t j = 0; j < incoming_idx; j++)
+	for (uint32_t q = 0; q < nr_rx_queues; q++)
 	{
-		cur = &incoming_array[j];
+		for (uint64_t j = 0; j < rx_results[q].incoming_idx; j++)
+		{
+			cur = &rx_results[q].incoming_array[j];
 
-		fprintf(fp, "%lu\t%lu\n",
-						((uint64_t)((cur->timestamp_rx - cur->timestamp_tx) / ((double)TICKS_PER_US / 1000))),
-						cur->flow_id);
+			if (nr_phases > 1)
+			{
+				fprintf(fp, "%lu\t%lu\t%u\n",
+								((uint64_t)((cur->timestamp_rx - cur->timestamp_tx) / ((double)TICKS_PER_US / 1000))),
+								cur->flow_id, find_phase(cur->timestamp_tx));
+			}
+			else
+			{
+				fprintf(fp, "%lu\t%lu\n",
+								((uint64_t)((cur->timestamp_rx - cur->timestamp_tx) / ((double)TICKS_PER_US / 1000))),
+								cur->flow_id);
+			}
+		}
 	}
 
 	// close the file
@@ -447,6 +1924,17 @@ void process_config_file(char *cfg_file)
 		dst_ipv4_addr = IPV4_ADDR(b3, b2, b1, b0);
 	}
 
+	// load the number of consecutive source addresses (starting at src)
+	entry = (char *)rte_cfgfile_get_entry(file, "ipv4", "src_count");
+	if (entry)
+	{
+		sscanf(entry, "%u", &src_ipv4_count);
+		if (src_ipv4_count == 0)
+		{
+			rte_exit(EXIT_FAILURE, "The number of source addresses must be positive.\n");
+		}
+	}
+
 	// load TCP destination port
 	entry = (char *)rte_cfgfile_get_entry(file, "tcp", "dst");
 	if (entry)
@@ -456,14 +1944,30 @@ void process_config_file(char *cfg_file)
 		dst_tcp_port = port;
 	}
 
+	// load the range of TCP source ports
+	entry = (char *)rte_cfgfile_get_entry(file, "tcp", "src_min");
+	if (entry)
+	{
+		sscanf(entry, "%hu", &src_tcp_port_min);
+	}
+	entry = (char *)rte_cfgfile_get_entry(file, "tcp", "src_max");
+	if (entry)
+	{
+		sscanf(entry, "%hu", &src_tcp_port_max);
+	}
+	if (src_tcp_port_min == 0 || src_tcp_port_min > src_tcp_port_max)
+	{
+		rte_exit(EXIT_FAILURE, "Invalid range of TCP source ports [%hu, %hu].\n", src_tcp_port_min, src_tcp_port_max);
+	}
+
 	// close the file
 	rte_cfgfile_close(file);
 }
 
-// Fill the data into packet payload properly
-inline void fill_payload_pkt(struct rte_mbuf *pkt, uint32_t idx, uint64_t value)
+// Fill the request header into packet payload properly (legacy or compact layout)
+void fill_payload_pkt(struct rte_mbuf *pkt, const wire_header_t *header)
 {
 	uint8_t *payload = (uint8_t *)rte_pktmbuf_mtod_offset(pkt, uint8_t *, PAYLOAD_OFFSET);
 
-	((uint64_t *)payload)[idx] = value;
+	header_write(payload, header);
 }
@@ -14,6 +14,8 @@
 #include <rte_flow.h>
 #include <rte_mbuf.h>
 #include <rte_ring.h>
+#include <rte_ring_elem.h>
+#include <rte_launch.h>
 #include <rte_ether.h>
 #include <rte_atomic.h>
 #include <rte_ethdev.h>
@@ -21,16 +23,51 @@
 #include <rte_cfgfile.h>
 #include <rte_mempool.h>
 
+#include "alias.h"
+#include "histogram.h"
+#include "classifier.h"
+#include "deferred.h"
+
 // Constants
 #define EPSILON 0.00001
 #define MAXSTRLEN 128
 #define MIN_PKTSIZE 96
+#define MAX_PKTSIZE (14 + 65535)
+#define DEFAULT_MSS 1460
+#define RESPONSE_HEADER_SIZE 32
+#define RESPONSE_SIZE_SHIFT 32
+#define RESPONSE_SIZE_MASK 0xffffff
+#define SIZE_CLASS_SHIFT 56
+#define SIZE_CLASS_MASK 0x3f
+#define SIZE_CLASSES 33
+#define MIN_MSS 536
+#define MAX_MSS 8960
 #define CONSTANT_VALUE 0
 #define UNIFORM_VALUE 1
 #define EXPONENTIAL_VALUE 2
 #define BIMODAL_VALUE 3
 #define LOGNORMAL_VALUE 4
 #define PARETO_VALUE 5
+#define EMPIRICAL_VALUE 6
+#define ECHO_VALUE 7
+#define FLOW_ROUND_ROBIN 0
+#define FLOW_UNIFORM 1
+#define FLOW_ZIPF 2
+#define FLOW_HOTSET 3
+#define FLOW_ONOFF 4
+#define ONOFF_MAX_DRAWS 16
+#define TX_START_DELAY_IN_US 100
+#define SCHEDULE_CHUNK_ELEMENTS 4096
+#define SCHEDULE_POOL_CHUNKS 64
+#define ALIAS_BLOCK_SIZE 16
+#define MAX_PHASES 64
+#define MAX_PROBES 32
+#define SEARCH_PRECISION 0.01
+#define SEARCH_DRAIN_IN_US 500000
+#define TIMER_WHEEL_TICK_US 10
+#define RTO_DRAIN_RTOS 4
+#define RETRANSMISSION_FLAG (1ULL << 63)
+#define FLOW_ID_MASK 0xffffffffULL
 #define IPV4_ADDR(a, b, c, d) (((d & 0xff) << 24) | ((c & 0xff) << 16) | ((b & 0xff) << 8) | (a & 0xff))
 
 #define PAYLOAD_OFFSET 14 + 20 + 20
@@ -47,25 +84,145 @@ typedef struct application_node_t
 {
 	uint64_t iterations;
 	uint64_t randomness;
+	uint32_t request_size;
+	uint32_t response_size;
 } application_node_t;
 
+// Distribution of the TCP payload sizes of the requests or the responses (ECHO_VALUE: each response as large as its request)
+typedef struct size_distribution_t
+{
+	int type;
+	uint32_t value0;
+	uint32_t value1;
+	double mode;
+	uint32_t min;
+	uint32_t max;
+	alias_table_t *table;
+} size_distribution_t;
+
+// Part of the run with its own rate (or linear ramp) and distribution
+typedef struct phase_t
+{
+	double rate_start;
+	double rate_end;
+	uint64_t duration;
+	int distribution;
+	uint64_t first;
+	uint64_t nr_elements;
+	uint64_t start_tsc;
+} phase_t;
+
+// Requests of the arrival schedule sent by one TX lcore, with their send times in ticks after the TX start
+// (all of its requests when the schedule is not streamed)
+typedef struct schedule_chunk_t
+{
+	uint64_t nr_elements;
+	uint64_t *deadline;
+	uint32_t *flow_indexes;
+	application_node_t *application;
+} schedule_chunk_t;
+
+// Range of the schedule filled by one lcore, with the send time before it and where its requests go in the TX lcores
+typedef struct schedule_fill_job_t
+{
+	uint64_t first;
+	uint64_t n;
+	uint64_t offset;
+	uint64_t *counts;
+} schedule_fill_job_t;
+
+// Result of one probe of the saturation search
+typedef struct probe_result_t
+{
+	double rate;
+	uint64_t scheduled;
+	uint64_t received;
+	uint64_t never_sent;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t slo_value;
+	int pass;
+} probe_result_t;
+
+typedef struct tx_batch_stats_t
+{
+	uint64_t nr_bursts;
+	uint64_t nr_pkts;
+	uint64_t early_ticks_sum;
+	uint64_t early_ticks_max;
+} __rte_cache_aligned tx_batch_stats_t;
+
+// Responses recorded by one RX lcore (merged into latency_histograms at the end)
+typedef struct rx_results_t
+{
+	uint8_t reset;
+	uint32_t incoming_idx;
+	uint64_t incoming_capacity;
+	uint64_t retransmitted;
+	uint64_t lost;
+	node_t *incoming_array;
+	histogram_t *histograms[MAX_PHASES];
+	histogram_t *size_histograms[SIZE_CLASSES];
+} __rte_cache_aligned rx_results_t;
+
+// Live counters of one lcore (single writer, read by telemetry and the live stats line)
+typedef struct lcore_counters_t
+{
+	uint64_t tx_pkts;
+	uint64_t never_sent;
+	uint64_t retransmitted;
+	uint64_t rx_pkts;
+	uint64_t rx_processed;
+} __rte_cache_aligned lcore_counters_t;
+
 extern uint64_t rate;
 extern uint32_t seed;
 extern uint16_t portid;
 extern uint64_t duration;
+extern uint64_t nr_elements;
+extern uint32_t nr_phases;
+extern phase_t phases[MAX_PHASES];
 extern uint64_t nr_flows;
 extern uint32_t frame_size;
 extern uint32_t min_lcores;
+extern uint32_t nr_tx_lcores;
+extern uint64_t tx_batch_window;
 extern uint32_t tcp_payload_size;
+extern uint32_t tcp_mss;
+extern uint8_t zero_copy;
+extern size_distribution_t request_sizes;
+extern size_distribution_t response_sizes;
+extern histogram_t *size_histograms[SIZE_CLASSES];
 
 extern uint64_t TICKS_PER_US;
+extern uint64_t tx_start_tsc;
 extern uint32_t nr_never_sent;
-extern uint16_t *flow_indexes_array;
-extern uint32_t *interarrival_array;
+extern tx_batch_stats_t tx_batch_stats[RTE_MAX_LCORE];
+extern lcore_counters_t lcore_counters[RTE_MAX_LCORE];
+extern uint8_t live_stats;
+extern uint32_t *flow_indexes_array;
+extern uint64_t *interarrival_array;
+
+extern uint32_t closed_loop_window;
+extern double think_time;
+extern struct rte_ring *completion_rings[RTE_MAX_LCORE];
+
+extern double slo_percentile;
+extern uint64_t slo_latency;
+
+extern uint8_t stream_schedule;
+extern uint8_t schedule_done;
+extern struct rte_mempool *schedule_pool;
+extern struct rte_ring *schedule_rings[RTE_MAX_LCORE];
+extern schedule_chunk_t schedule_array_chunks[RTE_MAX_LCORE];
 
 extern uint16_t dst_tcp_port;
 extern uint32_t dst_ipv4_addr;
 extern uint32_t src_ipv4_addr;
+extern uint32_t src_ipv4_count;
+extern uint16_t src_tcp_port_min;
+extern uint16_t src_tcp_port_max;
 extern struct rte_ether_addr dst_eth_addr;
 extern struct rte_ether_addr src_eth_addr;
 
@@ -73,9 +230,15 @@ extern uint8_t quit_rx;
 extern uint8_t quit_tx;
 extern uint8_t quit_rx_ring;
 
-extern uint32_t incoming_idx;
-extern node_t *incoming_array;
-extern application_node_t *application_array;
+extern uint32_t histogram_digits;
+extern histogram_t *latency_histograms[MAX_PHASES];
+extern uint32_t nr_rx_queues;
+extern uint8_t rx_inline;
+extern uint32_t handshake_window;
+extern uint64_t rto_us;
+extern uint8_t flow_classifier;
+extern rx_results_t rx_results[RTE_MAX_LCORE];
+extern deferred_queue_t *deferred_queues[RTE_MAX_LCORE];
 
 void clean_heap();
 void wait_timeout();
@@ -83,10 +246,62 @@ void print_dpdk_stats();
 void print_stats_output();
 void process_config_file();
 void create_incoming_array();
-void create_application_array();
+void create_latency_histograms();
+void create_deferred_queues();
+void merge_rx_results();
+void create_binary_output();
+void close_binary_output();
 void create_interarrival_array();
 void create_flow_indexes_array();
+void create_schedule();
+void free_schedule_arrays();
+void fill_schedule_arrays();
+void set_probe_phase(double probe_rate);
+void set_phases_start(uint64_t start_tsc);
+void evaluate_probe(probe_result_t *result, double probe_rate);
+void print_search_output(probe_result_t *results, uint32_t nr_probes, double max_rate);
+void create_schedule_stream();
+void create_completion_rings();
+void sample_application(application_node_t *node, uint64_t idx);
+double sample_exponential(double lambda, double u);
+void produce_schedule_chunk(uint64_t first, uint64_t n);
+schedule_chunk_t *next_schedule_chunk(uint32_t qid, schedule_chunk_t *prev);
 int app_parse_args(int argc, char **argv);
-void fill_payload_pkt(struct rte_mbuf *pkt, uint32_t idx, uint64_t value);
+
+// Update a live counter from its only writer (plain load and store, no locked instruction)
+static inline void counter_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+// Size class of a request (power-of-two bucket of the bytes it moves, request and response payloads together)
+static inline uint32_t size_class(uint32_t request_size, uint32_t response_size)
+{
+	return 63 - __builtin_clzll((uint64_t)request_size + response_size);
+}
+
+// Third word of the request payload, echoed back by the server: flow id, size of the response to send, and size class
+static inline uint64_t request_tag(uint32_t flow_id, uint32_t request_size, uint32_t response_size)
+{
+	return (uint64_t)flow_id | ((uint64_t)response_size << RESPONSE_SIZE_SHIFT) | ((uint64_t)size_class(request_size, response_size) << SIZE_CLASS_SHIFT);
+}
+
+// Size of the response asked by a retransmission (its original request is unknown)
+static inline uint32_t retransmission_response_size()
+{
+	return response_sizes.type == ECHO_VALUE ? request_sizes.min : response_sizes.min;
+}
+
+// Find the phase in which the request was scheduled
+static inline uint32_t find_phase(uint64_t timestamp_tx)
+{
+	uint32_t p = nr_phases - 1;
+	while (p > 0 && timestamp_tx < phases[p].start_tsc)
+	{
+		p--;
+	}
+
+	return p;
+}
 
 #endif // __UTIL_H__
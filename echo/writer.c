@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_eal.h>
+#include <rte_pause.h>
+
+#include "writer.h"
+
+// Open the binary output and create the blocks shared by the RX lcores (producers) and the writer lcore
+writer_t *writer_open(const char *filename, uint32_t nr_producers)
+{
+	writer_t *w = (writer_t *)rte_zmalloc(NULL, sizeof(writer_t), 64);
+	if (w == NULL)
+	{
+		return NULL;
+	}
+
+	// bypass the page cache when the file system allows it (the blocks are aligned for that)
+	w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (w->fd < 0 && errno == EINVAL)
+	{
+		w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (w->fd < 0)
+	{
+		rte_free(w);
+		return NULL;
+	}
+
+	// the records start right after the header
+	w->offset = WRITER_HEADER_SIZE;
+	w->nr_producers = nr_producers;
+
+	// several RX lcores take free blocks and hand full ones
+	unsigned free_flags = RING_F_SP_ENQ | (nr_producers > 1 ? 0 : RING_F_SC_DEQ);
+	unsigned full_flags = RING_F_SC_DEQ | (nr_producers > 1 ? 0 : RING_F_SP_ENQ);
+
+	w->producers = (writer_producer_t *)rte_zmalloc(NULL, nr_producers * sizeof(writer_producer_t), 64);
+	w->tails = (writer_block_t *)rte_zmalloc(NULL, nr_producers * sizeof(writer_block_t), 64);
+	w->blocks = (uint8_t *)rte_malloc(NULL, (uint64_t)WRITER_NR_BLOCKS * WRITER_BLOCK_SIZE, WRITER_ALIGN);
+	w->free_ring = rte_ring_create_elem("writer_free", sizeof(writer_block_t), 2 * WRITER_NR_BLOCKS, rte_socket_id(), free_flags);
+	w->full_ring = rte_ring_create_elem("writer_full", sizeof(writer_block_t), 2 * WRITER_NR_BLOCKS, rte_socket_id(), full_flags);
+	if (w->producers == NULL || w->tails == NULL || w->blocks == NULL || w->free_ring == NULL || w->full_ring == NULL)
+	{
+		close(w->fd);
+		rte_free(w->producers);
+		rte_free(w->tails);
+		rte_free(w->blocks);
+		rte_ring_free(w->free_ring);
+		rte_ring_free(w->full_ring);
+		rte_free(w);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < WRITER_NR_BLOCKS; i++)
+	{
+		writer_block_t block = {.buf = w->blocks + (uint64_t)i * WRITER_BLOCK_SIZE, .len = 0};
+		rte_ring_sp_enqueue_elem(w->free_ring, &block, sizeof(writer_block_t));
+	}
+
+	return w;
+}
+
+// Hand the last (partial) block of the producer to the writer lcore (the writer finishes after all producers)
+void writer_flush(writer_t *w, uint32_t producer)
+{
+	writer_producer_t *p = &w->producers[producer];
+	if (p->cur.buf != NULL && p->cur.len > 0)
+	{
+		rte_ring_enqueue_elem(w->full_ring, &p->cur, sizeof(writer_block_t));
+	}
+	p->cur.buf = NULL;
+
+	__atomic_fetch_add(&w->nr_done, 1, __ATOMIC_RELEASE);
+}
+
+// Write the whole buffer at the offset
+static int writer_pwrite(int fd, const uint8_t *buf, uint64_t len, uint64_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t n = pwrite(fd, buf, len, offset);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		buf += n;
+		len -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+// Write the block at the end of the file (only recycled after a failed write, the main lcore then stops the run)
+static void writer_append(writer_t *w, writer_block_t *block)
+{
+	if (likely(!w->failed))
+	{
+		if (writer_pwrite(w->fd, block->buf, block->len, w->offset) != 0)
+		{
+			fprintf(stderr, "Cannot write the binary output file: %s.\n", strerror(errno));
+			__atomic_store_n(&w->failed, 1, __ATOMIC_RELEASE);
+		}
+		w->offset += block->len;
+	}
+
+	rte_ring_enqueue_elem(w->free_ring, block, sizeof(writer_block_t));
+}
+
+// Stream the full blocks to the file until the RX lcores flush their last ones
+int lcore_writer(void *arg)
+{
+	writer_t *w = (writer_t *)arg;
+	writer_block_t block;
+
+	while (1)
+	{
+		if (rte_ring_sc_dequeue_elem(w->full_ring, &block, sizeof(writer_block_t)) != 0)
+		{
+			// the last blocks are enqueued before the RX lcores are counted as done
+			if (__atomic_load_n(&w->nr_done, __ATOMIC_ACQUIRE) == w->nr_producers && rte_ring_empty(w->full_ring))
+			{
+				break;
+			}
+			rte_pause();
+			continue;
+		}
+
+		// the last partial block of each RX lcore waits until all full blocks are written
+		if (block.len < WRITER_BLOCK_SIZE)
+		{
+			w->tails[w->nr_tails++] = block;
+			continue;
+		}
+
+		writer_append(w, &block);
+	}
+
+	// the partial blocks go back to back after the full ones, so the records stay contiguous (no padding in the file);
+	// their lengths are not aligned, so they bypass direct I/O
+	int flags = fcntl(w->fd, F_GETFL);
+	if (flags >= 0 && (flags & O_DIRECT))
+	{
+		fcntl(w->fd, F_SETFL, flags & ~O_DIRECT);
+	}
+	for (uint32_t i = 0; i < w->nr_tails; i++)
+	{
+		writer_append(w, &w->tails[i]);
+	}
+	w->nr_tails = 0;
+
+	return 0;
+}
+
+// Write the header and release everything (after the writer lcore finished)
+int writer_close(writer_t *w, writer_header_t *header)
+{
+	int ret = 0;
+
+	header->magic = WRITER_MAGIC;
+	header->version = WRITER_VERSION;
+	header->record_size = sizeof(writer_record_t);
+	for (uint32_t i = 0; i < w->nr_producers; i++)
+	{
+		header->nr_records += w->producers[i].nr_records;
+		header->nr_dropped += w->producers[i].nr_dropped;
+	}
+
+	// the header is written through an aligned buffer as well (not at all if the records could not be written)
+	uint8_t *buf = w->failed ? NULL : (uint8_t *)rte_zmalloc(NULL, WRITER_HEADER_SIZE, WRITER_ALIGN);
+	if (buf == NULL)
+	{
+		ret = -1;
+	}
+	else
+	{
+		memcpy(buf, header, sizeof(writer_header_t));
+		ret = writer_pwrite(w->fd, buf, WRITER_HEADER_SIZE, 0);
+		rte_free(buf);
+	}
+
+	close(w->fd);
+	rte_free(w->producers);
+	rte_free(w->tails);
+	rte_free(w->blocks);
+	rte_ring_free(w->free_ring);
+	rte_ring_free(w->full_ring);
+	rte_free(w);
+
+	return ret;
+}
@@ -0,0 +1,126 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stdint.h>
+
+#include <rte_ring.h>
+#include <rte_ring_elem.h>
+#include <rte_malloc.h>
+#include <rte_branch_prediction.h>
+
+#include "util.h"
+
+#define WRITER_MAGIC 0x3154554f4e49424cULL // "LBINOUT1"
+#define WRITER_VERSION 1
+#define WRITER_ALIGN 4096
+#define WRITER_HEADER_SIZE 4096
+#define WRITER_BLOCK_SIZE (1 << 20)
+#define WRITER_NR_BLOCKS 64
+
+// One response in the binary output (16 bytes)
+typedef struct writer_record_t
+{
+	uint64_t timestamp_tx;
+	uint32_t latency;
+	uint32_t flow_id;
+} writer_record_t;
+
+// Header at the beginning of the binary output (padded to WRITER_HEADER_SIZE), written when the run ends
+typedef struct writer_header_t
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t ticks_per_us;
+	uint64_t nr_records;
+	uint64_t nr_dropped;
+	uint32_t seed;
+	uint32_t distribution;
+	uint64_t rate;
+	uint64_t duration;
+	uint64_t nr_flows;
+	uint32_t frame_size;
+	uint32_t nr_tx_lcores;
+	uint64_t srv_distribution;
+	uint64_t srv_iterations0;
+	uint64_t srv_iterations1;
+	double srv_mode;
+	uint64_t tx_start_tsc;
+	uint32_t nr_phases;
+	uint32_t reserved;
+	uint64_t phases_start_tsc[MAX_PHASES];
+} writer_header_t;
+
+// Buffer handed from the RX lcore to the writer lcore
+typedef struct writer_block_t
+{
+	uint8_t *buf;
+	uint64_t len;
+} writer_block_t;
+
+// State of one RX lcore appending records (only written by that lcore)
+typedef struct writer_producer_t
+{
+	writer_block_t cur;
+	uint64_t nr_records;
+	uint64_t nr_dropped;
+} __rte_cache_aligned writer_producer_t;
+
+typedef struct writer_t
+{
+	int fd;
+	uint64_t offset;
+	uint32_t nr_producers;
+	uint32_t nr_done;
+	uint32_t nr_tails;
+	uint8_t failed;
+	uint8_t *blocks;
+	writer_block_t *tails;
+	struct rte_ring *free_ring;
+	struct rte_ring *full_ring;
+	writer_producer_t *producers;
+} writer_t;
+
+extern writer_t *bin_writer;
+
+writer_t *writer_open(const char *filename, uint32_t nr_producers);
+void writer_flush(writer_t *w, uint32_t producer);
+int lcore_writer(void *arg);
+int writer_close(writer_t *w, writer_header_t *header);
+
+// Check whether the writer lcore failed to write the file (the main lcore then stops the run)
+static inline int writer_failed(writer_t *w)
+{
+	return __atomic_load_n(&w->failed, __ATOMIC_ACQUIRE);
+}
+
+// Append one response (from the RX lcore of the producer): never blocks, the record is dropped when the writer falls behind
+static inline void writer_record(writer_t *w, uint32_t producer, uint64_t timestamp_tx, uint64_t latency, uint32_t flow_id)
+{
+	writer_producer_t *p = &w->producers[producer];
+	if (unlikely(p->cur.buf == NULL))
+	{
+		if (rte_ring_dequeue_elem(w->free_ring, &p->cur, sizeof(writer_block_t)) != 0)
+		{
+			p->nr_dropped++;
+			return;
+		}
+		p->cur.len = 0;
+	}
+
+	writer_record_t *record = (writer_record_t *)(p->cur.buf + p->cur.len);
+	record->timestamp_tx = timestamp_tx;
+	record->latency = latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency;
+	record->flow_id = flow_id;
+	p->cur.len += sizeof(writer_record_t);
+	p->nr_records++;
+
+	// hand the full block to the writer lcore
+	if (unlikely(p->cur.len == WRITER_BLOCK_SIZE))
+	{
+		rte_ring_enqueue_elem(w->full_ring, &p->cur, sizeof(writer_block_t));
+		p->cur.buf = NULL;
+	}
+}
+
+#endif // __WRITER_H__
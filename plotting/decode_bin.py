@@ -0,0 +1,52 @@
+import sys
+import bisect
+import struct
+
+# layout of writer_header_t and writer_record_t (echo/writer.h)
+HEADER_SIZE = 4096
+HEADER_FORMAT = '<QIIQQQIIQQQIIQQQdQII64Q'
+RECORD_FORMAT = '<QII'
+MAGIC = 0x3154554f4e49424c
+RECORDS_PER_READ = 65536
+
+if len(sys.argv) != 3:
+    print("usage: {} BINARY_FILE OUTPUT_FILE".format(sys.argv[0]))
+    sys.exit(1)
+
+record_size = struct.calcsize(RECORD_FORMAT)
+
+with open(sys.argv[1], 'rb') as f, open(sys.argv[2], 'w') as out:
+    fields = struct.unpack(HEADER_FORMAT, f.read(struct.calcsize(HEADER_FORMAT)))
+    (magic, version, size, ticks_per_us, nr_records, nr_dropped, seed, distribution,
+     rate, duration, nr_flows, frame_size, nr_tx_lcores, srv_distribution, srv_iterations0,
+     srv_iterations1, srv_mode, tx_start_tsc, nr_phases, _) = fields[:20]
+    phases_start_tsc = fields[20:20 + nr_phases]
+
+    if magic != MAGIC or size != record_size:
+        print("{} is not a load generator binary output".format(sys.argv[1]))
+        sys.exit(1)
+
+    print("ticks_per_us={} seed={} rate={} duration={} flows={} size={} records={} dropped={}".format(
+        ticks_per_us, seed, rate, duration, nr_flows, frame_size, nr_records, nr_dropped))
+
+    # same text format as the per-packet output file (-o), with the phase as a third column when there are more than one
+    # (the records of all RX queues are contiguous after the header, the last partial blocks without padding)
+    f.seek(HEADER_SIZE)
+    left = nr_records
+    while left > 0:
+        n = min(left, RECORDS_PER_READ)
+        data = f.read(n * record_size)
+        if len(data) < n * record_size:
+            print("{} is truncated: {} records missing".format(sys.argv[1], left - len(data) // record_size))
+            n = len(data) // record_size
+            data = data[:n * record_size]
+            left = n
+        lines = []
+        for timestamp_tx, latency, flow_id in struct.iter_unpack(RECORD_FORMAT, data):
+            if nr_phases > 1:
+                phase = max(bisect.bisect_right(phases_start_tsc, timestamp_tx) - 1, 0)
+                lines.append("{}\t{}\t{}\n".format(latency, flow_id, phase))
+            else:
+                lines.append("{}\t{}\n".format(latency, flow_id))
+        out.writelines(lines)
+        left -= n